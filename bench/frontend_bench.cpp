@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "semantic_analyzer.hpp"
+#include "compiler.hpp"
+#include "program_generator.hpp"
+
+// Front-end throughput on generated programs. Each shape is compiled
+// `iterations` times; the median and fastest run of every phase are
+// reported as CSV (default) or JSON, one row per shape and phase.
+
+using Clock = std::chrono::steady_clock;
+
+struct PhaseResult
+{
+    std::string phase;
+    std::vector<double> seconds;
+    size_t units = 0;
+    std::string unit;
+
+    double median() const
+    {
+        std::vector<double> sorted = seconds;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+
+    double fastest() const { return *std::min_element(seconds.begin(), seconds.end()); }
+};
+
+struct ShapeResult
+{
+    std::string name;
+    ProgramShape shape;
+    size_t bytes = 0;
+    std::vector<PhaseResult> phases;
+};
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+ShapeResult runShape(const std::string &name, const ProgramShape &shape, size_t iterations)
+{
+    std::string source = ProgramGenerator(shape).generate();
+    ShapeResult result;
+    result.name = name;
+    result.shape = shape;
+    result.bytes = source.size();
+    result.phases = {{"lex", {}, 0, "B"}, {"parse", {}, 0, "tok"}, {"analyze", {}, 0, "node"}};
+
+    for (size_t i = 0; i < iterations; i++)
+    {
+        auto start = Clock::now();
+        Lexer lexer(source);
+        auto tokens = lexer.tokenize();
+        result.phases[0].seconds.push_back(secondsSince(start));
+        result.phases[0].units = source.size();
+        result.phases[1].units = tokens.size();
+
+        start = Clock::now();
+        Parser parser(std::move(tokens));
+        auto ast = parser.parseProgram();
+        result.phases[1].seconds.push_back(secondsSince(start));
+
+        start = Clock::now();
+        SemanticAnalyzer analyzer;
+        analyzer.analyze(ast.get());
+        result.phases[2].seconds.push_back(secondsSince(start));
+        result.phases[2].units = countProgramNodes(ast.get());
+    }
+    return result;
+}
+
+void printCsv(const std::vector<ShapeResult> &results)
+{
+    std::printf("shape,functions,statements,expression_depth,nesting_depth,identifiers,seed,bytes,"
+                "phase,units,unit,median_ms,min_ms,units_per_second\n");
+    for (const auto &result : results)
+    {
+        const ProgramShape &s = result.shape;
+        for (const auto &phase : result.phases)
+        {
+            std::printf("%s,%zu,%zu,%zu,%zu,%zu,%u,%zu,%s,%zu,%s,%.4f,%.4f,%.0f\n", result.name.c_str(),
+                        s.functions, s.statements, s.expressionDepth, s.nestingDepth, s.identifiers,
+                        s.seed, result.bytes, phase.phase.c_str(), phase.units, phase.unit.c_str(),
+                        phase.median() * 1000.0, phase.fastest() * 1000.0, phase.units / phase.median());
+        }
+    }
+}
+
+void printJson(const std::vector<ShapeResult> &results)
+{
+    std::printf("[\n");
+    for (size_t r = 0; r < results.size(); r++)
+    {
+        const ShapeResult &result = results[r];
+        const ProgramShape &s = result.shape;
+        std::printf("  {\"shape\": \"%s\", \"functions\": %zu, \"statements\": %zu, \"expression_depth\": %zu, "
+                    "\"nesting_depth\": %zu, \"identifiers\": %zu, \"seed\": %u, \"bytes\": %zu, \"phases\": [\n",
+                    result.name.c_str(), s.functions, s.statements, s.expressionDepth, s.nestingDepth,
+                    s.identifiers, s.seed, result.bytes);
+        for (size_t p = 0; p < result.phases.size(); p++)
+        {
+            const PhaseResult &phase = result.phases[p];
+            std::printf("    {\"phase\": \"%s\", \"units\": %zu, \"unit\": \"%s\", \"median_ms\": %.4f, "
+                        "\"min_ms\": %.4f, \"units_per_second\": %.0f}%s\n",
+                        phase.phase.c_str(), phase.units, phase.unit.c_str(), phase.median() * 1000.0,
+                        phase.fastest() * 1000.0, phase.units / phase.median(),
+                        p + 1 < result.phases.size() ? "," : "");
+        }
+        std::printf("  ]}%s\n", r + 1 < results.size() ? "," : "");
+    }
+    std::printf("]\n");
+}
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --functions N          functions per program\n"
+              << "  --statements N         statements per function body\n"
+              << "  --expression-depth N   operator nesting in expressions\n"
+              << "  --nesting-depth N      if statement nesting\n"
+              << "  --identifiers N        distinct local variable names\n"
+              << "  --seed N               generator seed (default 1)\n"
+              << "  --iterations N         runs per shape (default 10)\n"
+              << "  --json                 print JSON instead of CSV\n"
+              << "  --print-source         print the generated program and exit\n"
+              << "Without shape options a fixed set of representative shapes is run.\n";
+}
+
+int main(int argc, char *argv[])
+{
+    ProgramShape custom;
+    bool customShape = false;
+    bool json = false;
+    bool printSource = false;
+    size_t iterations = 10;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json")
+        {
+            json = true;
+            continue;
+        }
+        if (arg == "--print-source")
+        {
+            printSource = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        size_t value = std::strtoul(argv[++i], nullptr, 10);
+        if (arg == "--iterations")
+            iterations = std::max<size_t>(1, value);
+        else if (arg == "--seed")
+            custom.seed = static_cast<uint32_t>(value);
+        else if (arg == "--functions")
+            custom.functions = value;
+        else if (arg == "--statements")
+            custom.statements = value;
+        else if (arg == "--expression-depth")
+            custom.expressionDepth = value;
+        else if (arg == "--nesting-depth")
+            custom.nestingDepth = value;
+        else if (arg == "--identifiers")
+            custom.identifiers = std::max<size_t>(1, value);
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        customShape = customShape || (arg != "--iterations" && arg != "--seed");
+    }
+
+    if (printSource)
+    {
+        std::cout << ProgramGenerator(custom).generate();
+        return 0;
+    }
+
+    std::vector<std::pair<std::string, ProgramShape>> shapes;
+    if (customShape)
+    {
+        shapes.push_back({"custom", custom});
+    }
+    else
+    {
+        //                   functions statements depth nesting identifiers seed
+        shapes.push_back({"small", {8, 8, 2, 1, 4, custom.seed}});
+        shapes.push_back({"wide", {128, 64, 2, 1, 16, custom.seed}});
+        shapes.push_back({"deep_expressions", {64, 16, 8, 1, 8, custom.seed}});
+        shapes.push_back({"nested", {64, 16, 2, 6, 8, custom.seed}});
+        shapes.push_back({"many_identifiers", {32, 64, 2, 2, 256, custom.seed}});
+    }
+
+    try
+    {
+        std::vector<ShapeResult> results;
+        for (const auto &shape : shapes)
+            results.push_back(runShape(shape.first, shape.second, iterations));
+        if (json)
+            printJson(results);
+        else
+            printCsv(results);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Size and shape of a generated program
+struct ProgramShape
+{
+    size_t functions = 16;
+    size_t statements = 32;     // statements per function body; nested blocks get a quarter
+    size_t expressionDepth = 3; // nesting of binary operators in an expression
+    size_t nestingDepth = 2;    // nesting of if statements
+    size_t identifiers = 8;     // distinct local variable names
+    uint32_t seed = 1;
+};
+
+// Generates valid programs of a given shape. The output depends only on the
+// shape: the engine is fixed, and numbers are drawn from it directly instead
+// of through std:: distributions, whose results differ between libraries.
+class ProgramGenerator
+{
+private:
+    ProgramShape shape;
+    std::mt19937 random;
+    std::string out;
+    std::vector<std::vector<std::string>> scopes; // names visible at each level
+    std::vector<size_t> arities;                  // of the functions generated so far
+    size_t nesting = 0;
+    std::string declaring; // not yet usable in its own initializer
+
+    size_t pick(size_t count) { return count == 0 ? 0 : random() % count; }
+
+    void indent()
+    {
+        out.append(4 * (scopes.size() - 1), ' ');
+    }
+
+    bool isDeclaredInCurrentScope(const std::string &name) const
+    {
+        for (const auto &declared : scopes.back())
+        {
+            if (declared == name)
+                return true;
+        }
+        return false;
+    }
+
+    std::string pickVisible()
+    {
+        std::vector<const std::string *> visible;
+        for (const auto &scope : scopes)
+        {
+            for (const auto &name : scope)
+            {
+                if (name != declaring)
+                    visible.push_back(&name);
+            }
+        }
+        if (visible.empty())
+            return std::to_string(pick(100));
+        return *visible[pick(visible.size())];
+    }
+
+    void expression(size_t depth)
+    {
+        if (depth == 0)
+        {
+            if (pick(3) == 0)
+                out += std::to_string(pick(1000));
+            else
+                out += pickVisible();
+            return;
+        }
+
+        // Occasionally call an earlier function, which keeps the call graph acyclic
+        if (!arities.empty() && pick(8) == 0)
+        {
+            size_t callee = pick(arities.size());
+            out += "f" + std::to_string(callee) + "(";
+            for (size_t i = 0; i < arities[callee]; i++)
+            {
+                if (i != 0)
+                    out += ", ";
+                expression(depth - 1);
+            }
+            out += ")";
+            return;
+        }
+
+        static const char *operators[] = {" + ", " - ", " * ", " / ", " < ", " > ", " == ", " <= "};
+        const char *op = operators[pick(8)];
+        out += "(";
+        expression(depth - 1);
+        out += op;
+        if (op[1] == '/')
+            out += std::to_string(1 + pick(9)); // never a constant zero divisor
+        else
+            expression(depth - 1);
+        out += ")";
+    }
+
+    void declaration()
+    {
+        size_t first = pick(shape.identifiers);
+        for (size_t i = 0; i < shape.identifiers; i++)
+        {
+            std::string name = "v" + std::to_string((first + i) % shape.identifiers);
+            if (!isDeclaredInCurrentScope(name))
+            {
+                indent();
+                out += "int " + name + " = ";
+                declaring = name;
+                expression(shape.expressionDepth);
+                declaring.clear();
+                out += ";\n";
+                scopes.back().push_back(name);
+                return;
+            }
+        }
+        assignment(); // every name is taken in this scope
+    }
+
+    void assignment()
+    {
+        indent();
+        out += "buf[" + std::to_string(pick(8)) + "] = ";
+        expression(shape.expressionDepth);
+        out += ";\n";
+    }
+
+    void ifStatement()
+    {
+        indent();
+        out += "if (";
+        expression(shape.expressionDepth);
+        out += ")\n";
+        size_t statements = std::max<size_t>(1, shape.statements / 4);
+        block(statements);
+        if (pick(2) == 0)
+        {
+            indent();
+            out += "else\n";
+            block(statements);
+        }
+    }
+
+    void statement()
+    {
+        size_t kind = pick(4);
+        if (kind == 0 && nesting < shape.nestingDepth)
+            ifStatement();
+        else if (kind == 1)
+            assignment();
+        else
+            declaration();
+    }
+
+    void block(size_t statements)
+    {
+        indent();
+        out += "{\n";
+        scopes.emplace_back();
+        nesting++;
+        for (size_t i = 0; i < statements; i++)
+            statement();
+        nesting--;
+        scopes.pop_back();
+        indent();
+        out += "}\n";
+    }
+
+    void function(size_t index)
+    {
+        size_t arity = pick(4);
+        out += "int f" + std::to_string(index) + "(";
+        scopes.emplace_back();
+        for (size_t i = 0; i < arity; i++)
+        {
+            std::string name = "p" + std::to_string(i);
+            out += (i == 0 ? "int " : ", int ") + name;
+            scopes.back().push_back(name);
+        }
+        out += ")\n{\n";
+
+        scopes.emplace_back();
+        out += "    int buf[8];\n";
+        for (size_t i = 0; i < shape.statements; i++)
+            statement();
+        indent();
+        out += "return ";
+        expression(shape.expressionDepth);
+        out += ";\n}\n\n";
+        scopes.clear();
+        arities.push_back(arity);
+    }
+
+public:
+    explicit ProgramGenerator(ProgramShape shape) : shape(shape), random(shape.seed) {}
+
+    std::string generate()
+    {
+        out.clear();
+        arities.clear();
+        random.seed(shape.seed);
+        for (size_t i = 0; i < shape.functions; i++)
+            function(i);
+        return out;
+    }
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+// Heap use of one phase: allocations made, bytes allocated, and how far the
+// live heap of the thread rose above its level when the phase began
+struct AllocationStats
+{
+    size_t count = 0;
+    size_t bytes = 0;
+    size_t peak = 0;
+    bool valid = false;
+
+    AllocationStats &operator+=(const AllocationStats &other)
+    {
+        count += other.count;
+        bytes += other.bytes;
+        peak = std::max(peak, other.peak); // phases of different inputs do not overlap in memory
+        valid = valid || other.valid;
+        return *this;
+    }
+};
+
+// Counts heap allocations per thread. The counting itself happens in the
+// replacement global operator new/delete of src/alloc_tracker.cpp; a program
+// that does not link it reports the tracker as unsupported. Counting is off
+// until enable() is called, so the hooks cost one relaxed load otherwise.
+//
+// Counters are per thread: memory freed by another thread than the one that
+// allocated it lowers the freeing thread's live heap, and work done on
+// threads a phase spawns is not attributed to it.
+class AllocationTracker
+{
+private:
+    struct ThreadState
+    {
+        size_t count = 0;
+        size_t bytes = 0;
+        long long live = 0;
+        long long peak = 0;
+    };
+
+    inline static std::atomic<bool> installed{false};
+    inline static std::atomic<bool> counting{false};
+    static thread_local ThreadState state;
+
+public:
+    struct Snapshot
+    {
+        size_t count = 0;
+        size_t bytes = 0;
+        long long live = 0;
+    };
+
+    // Called by the hooks
+    static void markInstalled() { installed.store(true, std::memory_order_relaxed); }
+
+    static void noteAllocation(size_t size)
+    {
+        if (!counting.load(std::memory_order_relaxed))
+            return;
+        state.count++;
+        state.bytes += size;
+        state.live += static_cast<long long>(size);
+        state.peak = std::max(state.peak, state.live);
+    }
+
+    static void noteDeallocation(size_t size)
+    {
+        if (counting.load(std::memory_order_relaxed))
+            state.live -= static_cast<long long>(size);
+    }
+
+    static bool supported() { return installed.load(std::memory_order_relaxed); }
+    static void enable() { counting.store(true, std::memory_order_relaxed); }
+    static bool enabled() { return counting.load(std::memory_order_relaxed); }
+
+    // Starts a phase on the calling thread
+    static Snapshot begin()
+    {
+        state.peak = state.live;
+        return Snapshot{state.count, state.bytes, state.live};
+    }
+
+    // What the calling thread allocated since `start`
+    static AllocationStats since(const Snapshot &start)
+    {
+        AllocationStats stats;
+        stats.count = state.count - start.count;
+        stats.bytes = state.bytes - start.bytes;
+        stats.peak = static_cast<size_t>(std::max(0LL, state.peak - start.live));
+        stats.valid = true;
+        return stats;
+    }
+};
+
+inline thread_local AllocationTracker::ThreadState AllocationTracker::state;
@@ -0,0 +1,146 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include "parser.hpp"
+#include "utils.hpp"
+
+// Helper function to print the AST
+inline void printAST(std::ostream &out, const ASTNode *node, int indent = 0)
+{
+    std::string indentation(indent * 2, ' ');
+
+    switch (node->getType())
+    {
+    case NodeType::Program:
+    {
+        auto *program = static_cast<const Program *>(node);
+        for (const auto &func : program->functions)
+        {
+            printAST(out, func.get(), indent);
+        }
+        break;
+    }
+    case NodeType::FunctionDecl:
+    {
+        auto *func = static_cast<const FunctionDeclaration *>(node);
+        out << indentation << "Function: " << func->name << std::endl;
+        for (const auto &param : func->parameters)
+        {
+            out << indentation << "  Parameter: " << param << std::endl;
+        }
+        printAST(out, func->body.get(), indent + 1);
+        break;
+    }
+    case NodeType::BlockStmt:
+    {
+        auto *block = static_cast<const BlockStatement *>(node);
+        out << indentation << "Block:" << std::endl;
+        for (const auto &stmt : block->statements)
+        {
+            printAST(out, stmt.get(), indent + 1);
+        }
+        break;
+    }
+    case NodeType::ReturnStmt:
+    {
+        auto *ret = static_cast<const ReturnStatement *>(node);
+        out << indentation << "Return:" << std::endl;
+        printAST(out, ret->value.get(), indent + 1);
+        break;
+    }
+    case NodeType::IfStmt:
+    {
+        auto *ifStmt = static_cast<const IfStatement *>(node);
+        out << indentation << "If Statement:";
+        if (ifStmt->hint == BranchHint::Likely)
+            out << " (likely)";
+        else if (ifStmt->hint == BranchHint::Unlikely)
+            out << " (unlikely)";
+        out << std::endl;
+        out << indentation << "  Condition:" << std::endl;
+        printAST(out, ifStmt->condition.get(), indent + 2);
+        out << indentation << "  Then:" << std::endl;
+        printAST(out, ifStmt->thenBranch.get(), indent + 2);
+        if (ifStmt->elseBranch)
+        {
+            out << indentation << "  Else:" << std::endl;
+            printAST(out, ifStmt->elseBranch.get(), indent + 2);
+        }
+        break;
+    }
+    case NodeType::VarDecl:
+    {
+        auto *var = static_cast<const VariableDeclaration *>(node);
+        out << indentation << "Variable Declaration: " << var->name << std::endl;
+        out << indentation << "  Initializer:" << std::endl;
+        printAST(out, var->initializer.get(), indent + 2);
+        break;
+    }
+    case NodeType::ArrayDecl:
+    {
+        auto *array = static_cast<const ArrayDeclaration *>(node);
+        out << indentation << "Array Declaration: " << array->name
+                  << "[" << array->size << "]" << std::endl;
+        break;
+    }
+    case NodeType::AssignStmt:
+    {
+        auto *assign = static_cast<const AssignmentStatement *>(node);
+        out << indentation << "Assignment:" << std::endl;
+        out << indentation << "  Target:" << std::endl;
+        printAST(out, assign->target.get(), indent + 2);
+        out << indentation << "  Value:" << std::endl;
+        printAST(out, assign->value.get(), indent + 2);
+        break;
+    }
+    case NodeType::BinaryExpr:
+    {
+        auto *binary = static_cast<const BinaryExpression *>(node);
+        out << indentation << "Binary Expression:" << std::endl;
+        out << indentation << "  Left:" << std::endl;
+        printAST(out, binary->left.get(), indent + 2);
+        out << indentation << "  Operator: " << tokenTypeToString(binary->op);
+        if (binary->op == TokenType::DIVIDE)
+            out << (binary->divisionCheck ? " (checked)" : " (check eliminated)");
+        out << std::endl;
+        out << indentation << "  Right:" << std::endl;
+        printAST(out, binary->right.get(), indent + 2);
+        break;
+    }
+    case NodeType::NumberExpr:
+    {
+        auto *num = static_cast<const NumberExpression *>(node);
+        out << indentation << "Number: " << num->value << std::endl;
+        break;
+    }
+    case NodeType::IdentifierExpr:
+    {
+        auto *id = static_cast<const IdentifierExpression *>(node);
+        out << indentation << "Identifier: " << id->name << std::endl;
+        break;
+    }
+    case NodeType::IndexExpr:
+    {
+        auto *index = static_cast<const IndexExpression *>(node);
+        out << indentation << "Index: " << index->array
+                  << (index->boundsCheck ? " (bounds checked)" : " (bounds check eliminated)") << std::endl;
+        printAST(out, index->index.get(), indent + 1);
+        break;
+    }
+    case NodeType::CallExpr:
+    {
+        auto *call = static_cast<const CallExpression *>(node);
+        out << indentation << "Call: " << call->callee;
+        if (call->tailCall == TailCall::Self)
+            out << " (self tail call)";
+        else if (call->tailCall == TailCall::Sibling)
+            out << " (sibling tail call)";
+        out << std::endl;
+        for (const auto &arg : call->arguments)
+        {
+            printAST(out, arg.get(), indent + 1);
+        }
+        break;
+    }
+    }
+}
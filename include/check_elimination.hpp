@@ -0,0 +1,158 @@
+#pragma once
+#include "parser.hpp"
+#include "range_analysis.hpp"
+
+// Removes runtime trap checks that range analysis proves can never fire:
+// IndexExpression::boundsCheck when the index lies within the array, and
+// BinaryExpression::divisionCheck when the divisor is never zero and the
+// division cannot overflow. Runs after semantic analysis, so every name is
+// known to be declared and every indexed name to be an array.
+class CheckEliminator
+{
+private:
+    RangeAnalysis ranges;
+    size_t eliminated = 0;
+
+    bool divisionIsSafe(const BinaryExpression *binary) const
+    {
+        ValueRange dividend = ranges.rangeOf(binary->left.get());
+        ValueRange divisor = ranges.rangeOf(binary->right.get());
+        if (!divisor.known || (divisor.min <= 0 && divisor.max >= 0))
+            return false;
+        // INT_MIN / -1 overflows and traps just like a zero divisor
+        bool mayBeMinusOne = divisor.min <= -1 && divisor.max >= -1;
+        bool mayBeIntMin = !dividend.known || dividend.min == INT_MIN;
+        return !(mayBeMinusOne && mayBeIntMin);
+    }
+
+    void visitExpression(Expression *expr)
+    {
+        switch (expr->getType())
+        {
+        case NodeType::BinaryExpr:
+        {
+            auto *binary = static_cast<BinaryExpression *>(expr);
+            visitExpression(binary->left.get());
+            visitExpression(binary->right.get());
+
+            if (binary->op == TokenType::DIVIDE && binary->divisionCheck && divisionIsSafe(binary))
+            {
+                binary->divisionCheck = false;
+                eliminated++;
+            }
+            break;
+        }
+        case NodeType::CallExpr:
+        {
+            auto *call = static_cast<CallExpression *>(expr);
+            for (auto &arg : call->arguments)
+            {
+                visitExpression(arg.get());
+            }
+            break;
+        }
+        case NodeType::IndexExpr:
+        {
+            auto *index = static_cast<IndexExpression *>(expr);
+            visitExpression(index->index.get());
+
+            size_t size = ranges.arraySize(index->array);
+            if (index->boundsCheck && size != 0 &&
+                ranges.rangeOf(index->index.get()).within(0, static_cast<long long>(size) - 1))
+            {
+                index->boundsCheck = false;
+                eliminated++;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void visitStatement(Statement *stmt)
+    {
+        switch (stmt->getType())
+        {
+        case NodeType::VarDecl:
+        {
+            auto *varDecl = static_cast<VariableDeclaration *>(stmt);
+            visitExpression(varDecl->initializer.get());
+            ranges.declare(varDecl->name, ranges.rangeOf(varDecl->initializer.get()));
+            break;
+        }
+        case NodeType::ArrayDecl:
+        {
+            auto *arrayDecl = static_cast<ArrayDeclaration *>(stmt);
+            ranges.declareArray(arrayDecl->name, arrayDecl->size);
+            break;
+        }
+        case NodeType::AssignStmt:
+        {
+            auto *assign = static_cast<AssignmentStatement *>(stmt);
+            visitExpression(assign->target.get());
+            visitExpression(assign->value.get());
+            break;
+        }
+        case NodeType::ReturnStmt:
+            visitExpression(static_cast<ReturnStatement *>(stmt)->value.get());
+            break;
+        case NodeType::IfStmt:
+        {
+            auto *ifStmt = static_cast<IfStatement *>(stmt);
+            visitExpression(ifStmt->condition.get());
+            ranges.enterScope();
+            visitStatement(ifStmt->thenBranch.get());
+            if (ifStmt->elseBranch)
+            {
+                visitStatement(ifStmt->elseBranch.get());
+            }
+            ranges.exitScope();
+            break;
+        }
+        case NodeType::BlockStmt:
+        {
+            auto *block = static_cast<BlockStatement *>(stmt);
+            ranges.enterScope();
+            for (auto &s : block->statements)
+            {
+                visitStatement(s.get());
+            }
+            ranges.exitScope();
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+public:
+    void run(FunctionDeclaration *func)
+    {
+        ranges.enterScope();
+        for (const auto &param : func->parameters)
+        {
+            ranges.declare(param, ValueRange::unknown());
+        }
+        visitStatement(func->body.get());
+        ranges.exitScope();
+    }
+
+    void run(Statement *root)
+    {
+        if (root->getType() == NodeType::Program)
+        {
+            for (auto &func : static_cast<Program *>(root)->functions)
+            {
+                run(func.get());
+            }
+        }
+        else if (root->getType() == NodeType::FunctionDecl)
+        {
+            run(static_cast<FunctionDeclaration *>(root));
+        }
+    }
+
+    // Number of checks removed so far
+    size_t eliminatedCount() const { return eliminated; }
+};
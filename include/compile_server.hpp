@@ -0,0 +1,421 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+#include "ast_printer.hpp"
+#include "compile_service.hpp"
+#include "thread_pool.hpp"
+
+// Wire protocol over a Unix stream socket. A connection carries any number
+// of requests, each answered in order. Integers are in host byte order,
+// since both ends are on the same machine.
+//
+//   Request   u8 kind ('C' compile, 'Q' stop the server), u8 flags,
+//             u32 name length, name, u32 source length, source
+//   Response  u8 status (0 success, 1 failure), u32 text length, text
+//
+// The name and source of a request together hold at most MAX_REQUEST_SIZE
+// bytes. The server answers a larger request with a failure and closes the
+// connection.
+namespace compile_protocol
+{
+    constexpr uint8_t COMPILE = 'C';
+    constexpr uint8_t QUIT = 'Q';
+    constexpr uint8_t DUMP_AST = 1; // flag: reply with the optimized AST
+    constexpr uint32_t MAX_REQUEST_SIZE = 64u << 20;
+    constexpr size_t READ_PIECE = 64 << 10; // strings grow as their bytes arrive, not from the length alone
+
+    // A string longer than the reader allows; its bytes are left unread
+    class TooLarge : public std::runtime_error
+    {
+    public:
+        explicit TooLarge(const std::string &message) : std::runtime_error(message) {}
+    };
+
+    inline void writeAll(int fd, const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t written = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                throw std::runtime_error(std::string("Socket write failed: ") + std::strerror(errno));
+            bytes += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    // Returns false if the peer closed the connection before any byte arrived
+    inline bool readAll(int fd, void *data, size_t size)
+    {
+        char *bytes = static_cast<char *>(data);
+        size_t total = 0;
+        while (total < size)
+        {
+            ssize_t got = ::read(fd, bytes + total, size - total);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                throw std::runtime_error("Socket read timed out");
+            if (got < 0)
+                throw std::runtime_error(std::string("Socket read failed: ") + std::strerror(errno));
+            if (got == 0)
+            {
+                if (total == 0)
+                    return false;
+                throw std::runtime_error("Connection closed mid-message");
+            }
+            total += static_cast<size_t>(got);
+        }
+        return true;
+    }
+
+    inline void writeString(int fd, const std::string &value)
+    {
+        uint32_t length = static_cast<uint32_t>(value.size());
+        writeAll(fd, &length, sizeof(length));
+        writeAll(fd, value.data(), value.size());
+    }
+
+    inline std::string readString(int fd, uint32_t maxLength = UINT32_MAX)
+    {
+        uint32_t length;
+        if (!readAll(fd, &length, sizeof(length)))
+            throw std::runtime_error("Connection closed mid-message");
+        if (length > maxLength)
+            throw TooLarge("Request exceeds " + std::to_string(MAX_REQUEST_SIZE) + " bytes");
+        std::string value;
+        while (value.size() < length)
+        {
+            size_t offset = value.size();
+            size_t piece = std::min<size_t>(READ_PIECE, length - offset);
+            value.resize(offset + piece);
+            if (!readAll(fd, &value[offset], piece))
+                throw std::runtime_error("Connection closed mid-message");
+        }
+        return value;
+    }
+
+    inline sockaddr_un socketAddress(const std::string &path)
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("Socket path too long: '" + path + "'");
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+}
+
+// Resident compiler daemon. All connections share one CompileService, so a
+// source seen before (by any client) is answered from the cache without
+// recompiling. The cache holds at most `cacheCapacity` results (0 =
+// unbounded), evicting the least recently used.
+//
+// Work is scheduled per request, not per connection: serve() polls the idle
+// connections and hands each incoming request to the pool, which reads it,
+// compiles it, replies, and returns the connection to the poll set. An idle
+// client therefore holds no worker. A client that stalls in the middle of a
+// request, or stops reading replies, holds one for at most IO_TIMEOUT_SECONDS
+// before it is disconnected.
+class CompileServer
+{
+public:
+    static constexpr int IO_TIMEOUT_SECONDS = 10;
+
+private:
+    std::string path;
+    CompileService service;
+    int listenFd = -1;
+    int wakeFds[2] = {-1, -1}; // self-pipe waking serve() out of poll
+    std::atomic<bool> stopping{false};
+    std::mutex returnedMutex;
+    std::vector<int> returned; // connections whose request was answered, to poll again
+    ThreadPool pool; // last: joined first, while the state its tasks use is alive
+
+    void wake()
+    {
+        char byte = 0;
+        ssize_t ignored = ::write(wakeFds[1], &byte, 1); // a full pipe already wakes
+        (void)ignored;
+    }
+
+    // Reads and answers one request. Returns false when the connection is
+    // done: closed by the client, broken, or a QUIT
+    bool handleRequest(int fd)
+    {
+        uint8_t header[2];
+        if (!compile_protocol::readAll(fd, header, sizeof(header)))
+            return false;
+        if (header[0] == compile_protocol::QUIT)
+        {
+            stop();
+            return false;
+        }
+        std::string name;
+        std::string source;
+        try
+        {
+            name = compile_protocol::readString(fd, compile_protocol::MAX_REQUEST_SIZE);
+            source = compile_protocol::readString(fd, compile_protocol::MAX_REQUEST_SIZE -
+                                                          static_cast<uint32_t>(name.size()));
+        }
+        catch (const compile_protocol::TooLarge &e)
+        {
+            // The rest of the request is never read, so the connection cannot continue
+            uint8_t status = 1;
+            compile_protocol::writeAll(fd, &status, sizeof(status));
+            compile_protocol::writeString(fd, std::string(e.what()) + "\n");
+            return false;
+        }
+
+        CompileService::ResultPtr result = service.compile(source);
+        uint8_t status = result->succeeded() ? 0 : 1;
+        std::string text;
+        if (!result->succeeded())
+        {
+            text = name + ": " + result->error + "\n";
+        }
+        else if (header[1] & compile_protocol::DUMP_AST)
+        {
+            std::ostringstream out;
+            out << name << ":\n";
+            printAST(out, result->ast.get());
+            text = out.str();
+        }
+        compile_protocol::writeAll(fd, &status, sizeof(status));
+        compile_protocol::writeString(fd, text);
+        return true;
+    }
+
+    void serveRequest(int fd)
+    {
+        bool keep = false;
+        try
+        {
+            keep = handleRequest(fd);
+        }
+        catch (const std::exception &)
+        {
+            // A broken connection only affects its own client
+        }
+        {
+            std::lock_guard<std::mutex> lock(returnedMutex);
+            if (keep && !stopping)
+            {
+                returned.push_back(fd);
+                wake();
+                return;
+            }
+        }
+        ::close(fd);
+    }
+
+    // Removes a socket left behind by a server that is gone. Anything else
+    // at the path (a regular file, or a socket someone still accepts on) is
+    // left alone and refuses the start.
+    static void removeStaleSocket(const std::string &path, const sockaddr_un &address)
+    {
+        struct stat info;
+        if (::lstat(path.c_str(), &info) != 0)
+            return;
+        if (!S_ISSOCK(info.st_mode))
+            throw std::runtime_error("Cannot listen on '" + path + "': file exists and is not a socket");
+
+        int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe < 0)
+            throw std::runtime_error(std::string("Cannot create socket: ") + std::strerror(errno));
+        bool live = ::connect(probe, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+        ::close(probe);
+        if (live)
+            throw std::runtime_error("Cannot listen on '" + path + "': a server is already running there");
+        ::unlink(path.c_str());
+    }
+
+public:
+    CompileServer(std::string socketPath, CompileOptions options, size_t threads, size_t cacheCapacity)
+        : path(std::move(socketPath)), service(options, cacheCapacity), pool(threads)
+    {
+        sockaddr_un address = compile_protocol::socketAddress(path);
+        removeStaleSocket(path, address);
+        if (::pipe(wakeFds) != 0)
+            throw std::runtime_error(std::string("Cannot create pipe: ") + std::strerror(errno));
+        ::fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listenFd, 64) != 0)
+        {
+            std::string error = std::strerror(errno);
+            if (listenFd >= 0)
+                ::close(listenFd);
+            ::close(wakeFds[0]);
+            ::close(wakeFds[1]);
+            throw std::runtime_error("Cannot listen on '" + path + "': " + error);
+        }
+    }
+
+    ~CompileServer()
+    {
+        ::close(listenFd);
+        ::unlink(path.c_str());
+        ::close(wakeFds[0]);
+        ::close(wakeFds[1]);
+    }
+
+    CompileServer(const CompileServer &) = delete;
+    CompileServer &operator=(const CompileServer &) = delete;
+
+    // Accepts connections and dispatches their requests until a client sends
+    // QUIT. Requests in progress then finish; idle connections are closed.
+    void serve()
+    {
+        std::vector<int> idle;
+        std::vector<pollfd> polled;
+        while (!stopping)
+        {
+            polled.clear();
+            polled.push_back(pollfd{listenFd, POLLIN, 0});
+            polled.push_back(pollfd{wakeFds[0], POLLIN, 0});
+            for (int fd : idle)
+                polled.push_back(pollfd{fd, POLLIN, 0});
+            if (::poll(polled.data(), polled.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (stopping)
+                break;
+
+            // Readable (or hung up) connections leave the poll set while a worker has them
+            std::vector<int> stillIdle;
+            for (size_t i = 2; i < polled.size(); i++)
+            {
+                int fd = polled[i].fd;
+                if (polled[i].revents == 0)
+                {
+                    stillIdle.push_back(fd);
+                    continue;
+                }
+                pool.submit([this, fd]()
+                            { serveRequest(fd); });
+            }
+            idle.swap(stillIdle);
+
+            if (polled[1].revents != 0)
+            {
+                char buffer[64];
+                while (::read(wakeFds[0], buffer, sizeof(buffer)) > 0)
+                {
+                }
+                std::lock_guard<std::mutex> lock(returnedMutex);
+                idle.insert(idle.end(), returned.begin(), returned.end());
+                returned.clear();
+            }
+
+            if (polled[0].revents != 0)
+            {
+                int fd = ::accept(listenFd, nullptr, nullptr);
+                if (fd >= 0)
+                {
+                    timeval timeout{IO_TIMEOUT_SECONDS, 0};
+                    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                    idle.push_back(fd);
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(returnedMutex);
+        stopping = true; // also after a poll failure, so workers stop handing connections back
+        for (int fd : idle)
+            ::close(fd);
+        for (int fd : returned)
+            ::close(fd);
+        returned.clear();
+    }
+
+    // Makes serve() return; requests in progress still get their reply
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(returnedMutex);
+        if (stopping)
+            return;
+        stopping = true;
+        wake();
+    }
+
+    CompileService::Statistics getStatistics() const { return service.getStatistics(); }
+};
+
+// Thin client: one connection, requests answered in the order sent
+class CompileClient
+{
+private:
+    int fd = -1;
+
+public:
+    explicit CompileClient(const std::string &path)
+    {
+        sockaddr_un address = compile_protocol::socketAddress(path);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            std::string error = std::strerror(errno);
+            if (fd >= 0)
+                ::close(fd);
+            throw std::runtime_error("Cannot connect to compile server at '" + path + "': " + error);
+        }
+    }
+
+    ~CompileClient() { ::close(fd); }
+
+    CompileClient(const CompileClient &) = delete;
+    CompileClient &operator=(const CompileClient &) = delete;
+
+    // Returns true on success; `text` receives diagnostics or the AST dump
+    bool compile(const std::string &name, const std::string &source, bool dumpAst, std::string &text)
+    {
+        if (name.size() + source.size() > compile_protocol::MAX_REQUEST_SIZE)
+        {
+            text = name + ": Error: larger than the compile server's limit of " +
+                   std::to_string(compile_protocol::MAX_REQUEST_SIZE) + " bytes\n";
+            return false;
+        }
+        uint8_t header[2] = {compile_protocol::COMPILE, static_cast<uint8_t>(dumpAst ? compile_protocol::DUMP_AST : 0)};
+        compile_protocol::writeAll(fd, header, sizeof(header));
+        compile_protocol::writeString(fd, name);
+        compile_protocol::writeString(fd, source);
+
+        uint8_t status;
+        if (!compile_protocol::readAll(fd, &status, sizeof(status)))
+            throw std::runtime_error("Compile server closed the connection");
+        text = compile_protocol::readString(fd);
+        return status == 0;
+    }
+
+    void stopServer()
+    {
+        uint8_t header[2] = {compile_protocol::QUIT, 0};
+        compile_protocol::writeAll(fd, header, sizeof(header));
+    }
+};
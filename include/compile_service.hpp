@@ -0,0 +1,188 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "compiler.hpp"
+
+// Thread-safe compilation front door with a shared result cache. Results are
+// keyed on the hash of the source (the full source is compared to rule out
+// collisions), and concurrent requests for the same source share a single
+// compilation: the first caller compiles, the rest wait on its future.
+//
+// The cache is split into shards, each behind a reader-writer lock, so hits
+// only take a shared lock on one shard and never contend with each other.
+// With a capacity, a shard that is full evicts its least recently used
+// finished entry before adding a new one. A hit records its use time in an
+// atomic, so hits still need only the shared lock.
+class CompileService
+{
+public:
+    using ResultPtr = std::shared_ptr<const CompileResult>;
+
+    struct Statistics
+    {
+        size_t hits = 0;    // served from a finished compilation
+        size_t joins = 0;   // waited on a compilation already in flight
+        size_t misses = 0;  // compiled
+        size_t evictions = 0; // finished results dropped to stay within capacity
+    };
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Entry
+    {
+        std::string source;
+        std::shared_future<ResultPtr> result;
+        mutable std::atomic<int64_t> lastUsed;
+
+        Entry(std::string source, std::shared_future<ResultPtr> result)
+            : source(std::move(source)), result(std::move(result)), lastUsed(now())
+        {
+        }
+    };
+
+    struct Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_multimap<size_t, Entry> entries;
+    };
+
+    CompileOptions options;
+    size_t shardCapacity; // 0 = unbounded
+    std::array<Shard, SHARD_COUNT> shards;
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> joins{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> evictions{0};
+
+    static int64_t now()
+    {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    static const Entry *find(const Shard &shard, size_t hash, const std::string &source)
+    {
+        auto range = shard.entries.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second.source == source)
+            {
+                it->second.lastUsed.store(now(), std::memory_order_relaxed);
+                return &it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    static bool isReady(const std::shared_future<ResultPtr> &result)
+    {
+        return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    // Makes room for one entry; called with the shard's exclusive lock held.
+    // Compilations in flight are never evicted, so a shard whose entries are
+    // all in flight may briefly exceed its capacity.
+    void evictFor(Shard &shard)
+    {
+        while (shardCapacity != 0 && shard.entries.size() >= shardCapacity)
+        {
+            auto oldest = shard.entries.end();
+            for (auto it = shard.entries.begin(); it != shard.entries.end(); ++it)
+            {
+                if (isReady(it->second.result) &&
+                    (oldest == shard.entries.end() || it->second.lastUsed < oldest->second.lastUsed))
+                    oldest = it;
+            }
+            if (oldest == shard.entries.end())
+                return;
+            shard.entries.erase(oldest);
+            evictions++;
+        }
+    }
+
+public:
+    // `capacity` bounds the number of cached results (0 = unbounded); it is
+    // split evenly across the shards
+    explicit CompileService(CompileOptions options = CompileOptions(), size_t capacity = 0)
+        : options(options), shardCapacity(capacity == 0 ? 0 : (capacity + SHARD_COUNT - 1) / SHARD_COUNT)
+    {
+    }
+
+    ResultPtr compile(const std::string &source)
+    {
+        size_t hash = std::hash<std::string>()(source);
+        Shard &shard = shards[hash % SHARD_COUNT];
+
+        // Fast path: shared lock only
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            if (const Entry *entry = find(shard, hash, source))
+            {
+                std::shared_future<ResultPtr> result = entry->result;
+                lock.unlock();
+                (isReady(result) ? hits : joins)++;
+                return result.get();
+            }
+        }
+
+        std::promise<ResultPtr> promise;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            if (const Entry *entry = find(shard, hash, source))
+            {
+                // Another thread registered it between the two locks
+                std::shared_future<ResultPtr> result = entry->result;
+                lock.unlock();
+                (isReady(result) ? hits : joins)++;
+                return result.get();
+            }
+            evictFor(shard);
+            shard.entries.emplace(std::piecewise_construct, std::forward_as_tuple(hash),
+                                  std::forward_as_tuple(source, promise.get_future().share()));
+        }
+
+        // Each calling thread keeps one context, so its buffers are reused across requests
+        misses++;
+        thread_local CompilationContext context;
+        context.setOptions(options);
+        context.compile(source);
+        ResultPtr result = std::make_shared<const CompileResult>(context.takeResult());
+        promise.set_value(result);
+        return result;
+    }
+
+    Statistics getStatistics() const
+    {
+        Statistics stats;
+        stats.hits = hits;
+        stats.joins = joins;
+        stats.misses = misses;
+        stats.evictions = evictions;
+        return stats;
+    }
+
+    // Drops finished results; compilations in flight stay so waiters still resolve
+    void clear()
+    {
+        for (auto &shard : shards)
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            for (auto it = shard.entries.begin(); it != shard.entries.end();)
+            {
+                it = isReady(it->second.result) ? shard.entries.erase(it) : std::next(it);
+            }
+        }
+    }
+};
@@ -0,0 +1,240 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "semantic_analyzer.hpp"
+#include "passes.hpp"
+#include "parallel_pipeline.hpp"
+#include "module_format.hpp"
+#include "time_report.hpp"
+
+struct CompileOptions
+{
+    int optLevel = 1;
+    unsigned jobs = 1; // worker threads for per-function optimization
+    PassBudget budget;
+    bool timeReport = false;        // fill CompileResult::timings
+    bool perfCounters = false;      // add hardware counters to the timings
+    bool allocationStats = false;   // add heap allocations to the timings
+    TraceRecorder *trace = nullptr; // span per phase, function and pass
+};
+
+// Measures consecutive phases into a TimeReport and the trace, as far as
+// the options ask for them
+class PhaseTimer
+{
+private:
+    const CompileOptions &options;
+    TimeReport &timings;
+    TimeReport::Clock::time_point start;
+    PerfSample counters;
+    AllocationTracker::Snapshot heap;
+
+public:
+    PhaseTimer(const CompileOptions &options, TimeReport &timings) : options(options), timings(timings)
+    {
+        if (options.perfCounters && !PerfCounters::forThisThread().available())
+            timings.setCountersUnavailable(PerfCounters::forThisThread().unavailableReason());
+        if (options.allocationStats && !AllocationTracker::supported())
+            timings.setAllocationsUnavailable();
+    }
+
+    void begin()
+    {
+        if (options.perfCounters)
+            counters = PerfCounters::forThisThread().read();
+        if (options.allocationStats)
+            heap = AllocationTracker::begin();
+        start = TimeReport::Clock::now();
+    }
+
+    void end(const char *name, size_t units, const char *unit)
+    {
+        if (options.timeReport)
+        {
+            PerfSample delta;
+            if (options.perfCounters)
+                delta = PerfCounters::forThisThread().read() - counters;
+            AllocationStats allocations;
+            if (options.allocationStats && AllocationTracker::supported())
+                allocations = AllocationTracker::since(heap);
+            timings.record(name, start, units, unit, options.perfCounters ? &delta : nullptr,
+                           allocations.valid ? &allocations : nullptr);
+        }
+        if (options.trace)
+            options.trace->record(name, "phase", start);
+    }
+};
+
+// Everything one compilation produces. On failure `ast` is null and
+// `error` holds the message in the form the driver prints.
+struct CompileResult
+{
+    std::unique_ptr<Statement> ast;
+    std::unordered_map<std::string, size_t> frameSizes;
+    std::vector<PassStatistics> statistics;
+    size_t tokenCount = 0;
+    TimeReport timings;
+    std::string error;
+
+    bool succeeded() const { return ast != nullptr; }
+};
+
+// AST nodes in a whole program, the work unit of the later phases
+inline size_t countProgramNodes(const Statement *root)
+{
+    if (root->getType() != NodeType::Program)
+        return NodeCountAnalysis::countStatement(root);
+    size_t count = 1;
+    for (const auto &func : static_cast<const Program *>(root)->functions)
+        count += NodeCountAnalysis::run(*func);
+    return count;
+}
+
+// Reusable compilation state for embedding the compiler. A context compiles
+// one source buffer at a time and owns the result until the next compile or
+// reset(). The source and token buffers, the analyzer's tables and the module
+// writer's string interner and code buffer keep their capacity across
+// compilations, so a long-lived context stops allocating for them once it has
+// seen its largest input. AST nodes are still allocated per compilation.
+class CompilationContext
+{
+private:
+    CompileOptions options;
+    Lexer lexer{std::string()};
+    std::vector<Token> tokens;
+    SemanticAnalyzer analyzer;
+    ModuleWriter writer;
+    std::vector<uint8_t> module;
+    bool moduleCurrent = false;
+    CompileResult result;
+
+public:
+    explicit CompilationContext(CompileOptions options = CompileOptions()) : options(options) {}
+
+    CompilationContext(const CompilationContext &) = delete;
+    CompilationContext &operator=(const CompilationContext &) = delete;
+
+    const CompileOptions &getOptions() const { return options; }
+    void setOptions(const CompileOptions &newOptions) { options = newOptions; }
+
+    // Lexes, parses, analyzes and optimizes `source`, replacing the previous
+    // result. Returns false on error; getError() then holds the message.
+    bool compile(const std::string &source)
+    {
+        reset();
+        PhaseTimer phase(options, result.timings);
+        try
+        {
+            phase.begin();
+            lexer.reset(source);
+            lexer.tokenize(tokens);
+            result.tokenCount = tokens.size();
+            phase.end("lex", source.size(), "B");
+
+            phase.begin();
+            std::unique_ptr<Statement> ast;
+            {
+                // The token buffer comes back whether or not parsing succeeds
+                Parser parser(std::move(tokens));
+                try
+                {
+                    ast = parser.parseProgram();
+                }
+                catch (...)
+                {
+                    tokens = parser.releaseTokens();
+                    throw;
+                }
+                tokens = parser.releaseTokens();
+            }
+            phase.end("parse", result.tokenCount, "tok");
+
+            size_t nodes = options.timeReport ? countProgramNodes(ast.get()) : 0;
+            phase.begin();
+            analyzer.reset();
+            analyzer.analyze(ast.get());
+            phase.end("analyze", nodes, "node");
+            for (const auto &func : static_cast<const Program *>(ast.get())->functions)
+            {
+                result.frameSizes[func->name] = analyzer.getFrameSize(func->name);
+            }
+
+            phase.begin();
+            PassBudget budget = options.budget;
+            int optLevel = options.optLevel;
+            ParallelPipeline pipeline([optLevel, budget]()
+                                      {
+                                          PassManager passes = createPipeline(optLevel);
+                                          passes.setBudget(budget);
+                                          return passes; },
+                                      options.jobs);
+            pipeline.setTrace(options.trace);
+            pipeline.run(ast.get());
+            phase.end("optimize", nodes, "node");
+            result.statistics = pipeline.getStatistics();
+            result.ast = std::move(ast);
+        }
+        catch (const SemanticError &e)
+        {
+            result.error = std::string("Semantic Error: ") + e.what();
+        }
+        catch (const std::exception &e)
+        {
+            result.error = std::string("Error: ") + e.what();
+        }
+        return result.succeeded();
+    }
+
+    const CompileResult &getResult() const { return result; }
+    const Statement *getAST() const { return result.ast.get(); }
+    const std::string &getError() const { return result.error; }
+
+    // The last compiled program in the binary module format, serialized on
+    // first request
+    const std::vector<uint8_t> &getModule()
+    {
+        if (!result.succeeded())
+            throw std::runtime_error("No compiled program to emit");
+        if (!moduleCurrent)
+        {
+            writer.write(*static_cast<const Program *>(result.ast.get()), module);
+            moduleCurrent = true;
+        }
+        return module;
+    }
+
+    // Moves the result out, leaving the context empty
+    CompileResult takeResult()
+    {
+        CompileResult taken = std::move(result);
+        reset();
+        return taken;
+    }
+
+    // Drops the last result; buffers keep their capacity
+    void reset()
+    {
+        result.ast.reset();
+        result.frameSizes.clear();
+        result.statistics.clear();
+        result.tokenCount = 0;
+        result.timings.clear();
+        result.error.clear();
+        module.clear();
+        moduleCurrent = false;
+    }
+};
+
+// Lex, parse, analyze and optimize one source buffer
+inline CompileResult compileSource(const std::string &source, const CompileOptions &options = CompileOptions())
+{
+    CompilationContext context(options);
+    context.compile(source);
+    return context.takeResult();
+}
@@ -0,0 +1,88 @@
+#ifndef COULSTOCK_H
+#define COULSTOCK_H
+
+/* C interface to the compiler, for hosts calling it over FFI.
+ *
+ * Every call returns normally: C++ exceptions are caught at the boundary
+ * and turned into status codes. Strings and byte buffers are returned as
+ * views into memory owned by the context. They are not NUL-terminated
+ * unless stated, and stay valid until the next compile, reset or destroy
+ * of that context. A context must not be used from two threads at once;
+ * separate contexts are independent. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define COULSTOCK_API_VERSION 1
+
+    typedef struct coulstock_context coulstock_context;
+
+    typedef enum coulstock_status
+    {
+        COULSTOCK_OK = 0,
+        COULSTOCK_COMPILE_ERROR = 1,    /* diagnostics in coulstock_error() */
+        COULSTOCK_INVALID_ARGUMENT = 2, /* null pointer or index out of range */
+        COULSTOCK_NO_RESULT = 3,        /* nothing compiled successfully yet */
+        COULSTOCK_INTERNAL_ERROR = 4    /* out of memory or similar; see coulstock_error() */
+    } coulstock_status;
+
+    typedef struct coulstock_string
+    {
+        const char *data;
+        size_t size;
+    } coulstock_string;
+
+    typedef struct coulstock_bytes
+    {
+        const uint8_t *data;
+        size_t size;
+    } coulstock_bytes;
+
+    /* Fields may be added at the end; struct_size tells the library which
+     * ones the caller knows about. Initialize with coulstock_options_init. */
+    typedef struct coulstock_options
+    {
+        size_t struct_size;
+        int opt_level;         /* 0, 1 or 2 */
+        unsigned jobs;         /* worker threads for per-function optimization */
+        double budget_seconds; /* per-function optimization budget, 0 = none */
+        size_t budget_work;    /* per-function work budget in AST nodes, 0 = none */
+    } coulstock_options;
+
+    int coulstock_api_version(void);
+    void coulstock_options_init(coulstock_options *options);
+
+    /* Returns NULL if the context cannot be allocated. `options` may be NULL. */
+    coulstock_context *coulstock_context_create(const coulstock_options *options);
+    void coulstock_context_destroy(coulstock_context *context);
+
+    /* Drops the last result; buffers are kept for the next compilation */
+    void coulstock_context_reset(coulstock_context *context);
+
+    /* Lexes, parses, analyzes and optimizes `size` bytes of source */
+    coulstock_status coulstock_compile(coulstock_context *context, const char *source, size_t size);
+
+    /* Message of the last failed call, empty after a success */
+    coulstock_string coulstock_error(const coulstock_context *context);
+
+    /* Functions of the last compiled program */
+    size_t coulstock_function_count(const coulstock_context *context);
+    coulstock_string coulstock_function_name(const coulstock_context *context, size_t index);
+    coulstock_status coulstock_frame_size(const coulstock_context *context, size_t index, size_t *slots);
+
+    /* The last compiled program in the binary module format */
+    coulstock_status coulstock_module(coulstock_context *context, coulstock_bytes *module);
+
+    /* The optimized AST as printed by --dump-ast */
+    coulstock_status coulstock_ast_text(coulstock_context *context, coulstock_string *text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,462 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON value for the language server protocol. Objects keep their
+// members in insertion order and are searched linearly; LSP messages are
+// small and shallow.
+class JsonValue
+{
+public:
+    enum class Type
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+private:
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> elements;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    // Length of the valid UTF-8 sequence at `i`, or 0 if it is malformed
+    // (stray continuation byte, truncated, overlong, or a surrogate)
+    static size_t utf8Length(const std::string &value, size_t i)
+    {
+        unsigned char lead = static_cast<unsigned char>(value[i]);
+        size_t length;
+        unsigned char low = 0x80, high = 0xBF; // allowed range of the second byte
+        if (lead < 0x80)
+        {
+            return 1;
+        }
+        else if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            length = 2;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            length = 3;
+            low = lead == 0xE0 ? 0xA0 : 0x80;
+            high = lead == 0xED ? 0x9F : 0xBF;
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            length = 4;
+            low = lead == 0xF0 ? 0x90 : 0x80;
+            high = lead == 0xF4 ? 0x8F : 0xBF;
+        }
+        else
+        {
+            return 0;
+        }
+        if (i + length > value.size())
+            return 0;
+        for (size_t k = 1; k < length; k++)
+        {
+            unsigned char byte = static_cast<unsigned char>(value[i + k]);
+            if (byte < (k == 1 ? low : 0x80) || byte > (k == 1 ? high : 0xBF))
+                return 0;
+        }
+        return length;
+    }
+
+    // Invalid UTF-8 is written as U+FFFD, so the output is always valid JSON
+    static void writeString(std::string &out, const std::string &value)
+    {
+        out += '"';
+        for (size_t i = 0; i < value.size(); i++)
+        {
+            char c = value[i];
+            if (static_cast<unsigned char>(c) >= 0x80)
+            {
+                size_t length = utf8Length(value, i);
+                if (length == 0)
+                {
+                    out += "\xEF\xBF\xBD";
+                    continue;
+                }
+                out.append(value, i, length);
+                i += length - 1;
+                continue;
+            }
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                }
+                else
+                {
+                    out += c;
+                }
+            }
+        }
+        out += '"';
+    }
+
+public:
+    JsonValue() = default;
+    JsonValue(std::nullptr_t) {}
+    JsonValue(bool value) : type(Type::Bool), boolean(value) {}
+    JsonValue(int value) : type(Type::Number), number(value) {}
+    JsonValue(size_t value) : type(Type::Number), number(static_cast<double>(value)) {}
+    JsonValue(double value) : type(Type::Number), number(value) {}
+    JsonValue(const char *value) : type(Type::String), text(value) {}
+    JsonValue(std::string value) : type(Type::String), text(std::move(value)) {}
+
+    static JsonValue array()
+    {
+        JsonValue value;
+        value.type = Type::Array;
+        return value;
+    }
+
+    static JsonValue object()
+    {
+        JsonValue value;
+        value.type = Type::Object;
+        return value;
+    }
+
+    Type getType() const { return type; }
+    bool isNull() const { return type == Type::Null; }
+    bool isString() const { return type == Type::String; }
+    bool isNumber() const { return type == Type::Number; }
+    bool isObject() const { return type == Type::Object; }
+
+    bool asBool() const { return boolean; }
+    double asNumber() const { return number; }
+    const std::string &asString() const { return text; }
+    const std::vector<JsonValue> &asArray() const { return elements; }
+
+    // Member lookup; a missing member (or a non-object) yields null
+    const JsonValue &operator[](const std::string &key) const
+    {
+        static const JsonValue null;
+        for (const auto &member : members)
+        {
+            if (member.first == key)
+                return member.second;
+        }
+        return null;
+    }
+
+    JsonValue &set(const std::string &key, JsonValue value)
+    {
+        for (auto &member : members)
+        {
+            if (member.first == key)
+            {
+                member.second = std::move(value);
+                return *this;
+            }
+        }
+        members.emplace_back(key, std::move(value));
+        return *this;
+    }
+
+    JsonValue &push(JsonValue value)
+    {
+        elements.push_back(std::move(value));
+        return *this;
+    }
+
+    void write(std::string &out) const
+    {
+        switch (type)
+        {
+        case Type::Null:
+            out += "null";
+            break;
+        case Type::Bool:
+            out += boolean ? "true" : "false";
+            break;
+        case Type::Number:
+        {
+            char buffer[32];
+            if (number == static_cast<double>(static_cast<long long>(number)))
+                std::snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(number));
+            else
+                std::snprintf(buffer, sizeof(buffer), "%.17g", number);
+            out += buffer;
+            break;
+        }
+        case Type::String:
+            writeString(out, text);
+            break;
+        case Type::Array:
+            out += '[';
+            for (size_t i = 0; i < elements.size(); i++)
+            {
+                if (i != 0)
+                    out += ',';
+                elements[i].write(out);
+            }
+            out += ']';
+            break;
+        case Type::Object:
+            out += '{';
+            for (size_t i = 0; i < members.size(); i++)
+            {
+                if (i != 0)
+                    out += ',';
+                writeString(out, members[i].first);
+                out += ':';
+                members[i].second.write(out);
+            }
+            out += '}';
+            break;
+        }
+    }
+
+    std::string dump() const
+    {
+        std::string out;
+        write(out);
+        return out;
+    }
+
+    static JsonValue parse(const std::string &source);
+};
+
+// Recursive-descent JSON reader; throws std::runtime_error on malformed input
+class JsonParser
+{
+private:
+    const std::string &source;
+    size_t position = 0;
+
+    [[noreturn]] void fail(const std::string &message) const
+    {
+        throw std::runtime_error("JSON " + message + " at offset " + std::to_string(position));
+    }
+
+    void skipWhitespace()
+    {
+        while (position < source.size() &&
+               (source[position] == ' ' || source[position] == '\t' || source[position] == '\n' ||
+                source[position] == '\r'))
+            position++;
+    }
+
+    bool consume(const char *literal)
+    {
+        size_t length = std::char_traits<char>::length(literal);
+        if (source.compare(position, length, literal) != 0)
+            return false;
+        position += length;
+        return true;
+    }
+
+    static void appendUtf8(std::string &out, unsigned long code)
+    {
+        if (code < 0x80)
+        {
+            out += static_cast<char>(code);
+        }
+        else if (code < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    unsigned long parseHex4()
+    {
+        if (position + 4 > source.size())
+            fail("truncated \\u escape");
+        std::string digits = source.substr(position, 4);
+        char *end;
+        unsigned long code = std::strtoul(digits.c_str(), &end, 16);
+        if (end != digits.c_str() + 4)
+            fail("invalid \\u escape");
+        position += 4;
+        return code;
+    }
+
+    std::string parseString()
+    {
+        position++; // opening quote
+        std::string out;
+        while (true)
+        {
+            if (position >= source.size())
+                fail("unterminated string");
+            char c = source[position++];
+            if (c == '"')
+                return out;
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+            if (position >= source.size())
+                fail("unterminated string");
+            char escape = source[position++];
+            switch (escape)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                out += escape;
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u':
+            {
+                unsigned long code = parseHex4();
+                if (code >= 0xD800 && code < 0xDC00 && consume("\\u"))
+                {
+                    unsigned long low = parseHex4();
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(out, code);
+                break;
+            }
+            default:
+                fail("invalid escape");
+            }
+        }
+    }
+
+    JsonValue parseValue(int depth)
+    {
+        if (depth > 256)
+            fail("nested too deeply");
+        skipWhitespace();
+        if (position >= source.size())
+            fail("unexpected end of input");
+
+        char c = source[position];
+        if (c == '{')
+        {
+            position++;
+            JsonValue object = JsonValue::object();
+            skipWhitespace();
+            if (consume("}"))
+                return object;
+            while (true)
+            {
+                skipWhitespace();
+                if (position >= source.size() || source[position] != '"')
+                    fail("expected member name");
+                std::string key = parseString();
+                skipWhitespace();
+                if (!consume(":"))
+                    fail("expected ':'");
+                object.set(key, parseValue(depth + 1));
+                skipWhitespace();
+                if (consume("}"))
+                    return object;
+                if (!consume(","))
+                    fail("expected ',' or '}'");
+            }
+        }
+        if (c == '[')
+        {
+            position++;
+            JsonValue array = JsonValue::array();
+            skipWhitespace();
+            if (consume("]"))
+                return array;
+            while (true)
+            {
+                array.push(parseValue(depth + 1));
+                skipWhitespace();
+                if (consume("]"))
+                    return array;
+                if (!consume(","))
+                    fail("expected ',' or ']'");
+            }
+        }
+        if (c == '"')
+            return JsonValue(parseString());
+        if (consume("true"))
+            return JsonValue(true);
+        if (consume("false"))
+            return JsonValue(false);
+        if (consume("null"))
+            return JsonValue();
+
+        const char *start = source.c_str() + position;
+        char *end;
+        double number = std::strtod(start, &end);
+        if (end == start)
+            fail("unexpected character");
+        position += static_cast<size_t>(end - start);
+        return JsonValue(number);
+    }
+
+public:
+    explicit JsonParser(const std::string &source) : source(source) {}
+
+    JsonValue parse()
+    {
+        JsonValue value = parseValue(0);
+        skipWhitespace();
+        if (position != source.size())
+            fail("trailing characters");
+        return value;
+    }
+};
+
+inline JsonValue JsonValue::parse(const std::string &source)
+{
+    return JsonParser(source).parse();
+}
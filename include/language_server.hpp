@@ -0,0 +1,710 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "json.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "semantic_analyzer.hpp"
+
+// LSP diagnostic on a single line
+struct Diagnostic
+{
+    size_t line = 0;
+    size_t character = 0;
+    size_t endCharacter = 0;
+    std::string message;
+};
+
+// Compile state of one open document. Positions follow LSP: zero-based
+// lines, and characters counted in UTF-16 code units.
+//
+// The text is held as a list of chunks, each starting at a function header
+// `int name(` and running up to the next one. Headers cannot occur inside a
+// body, so a missing '}' only spoils its own chunk. Chunks know their size in
+// lines but not their position, so an edit replaces the chunks it touches and
+// leaves every other one alone. The model keeps the signature each name
+// resolves to and, per name, the chunks calling it: a replaced chunk is
+// analyzed again, along with the callers of any signature it changed.
+// Diagnostics are kept per chunk, relative to its start.
+class DocumentModel
+{
+private:
+    struct Chunk
+    {
+        // Read for every chunk on each edit, so kept together at the front
+        size_t newlines = 0;
+        size_t tailUnits = 0;                // UTF-16 units after the last newline
+        std::vector<Diagnostic> diagnostics; // relative to the chunk start
+
+        std::string text;
+
+        std::vector<Token> tokens;
+        std::unique_ptr<Statement> program; // null when lexing or parsing failed
+        std::string error;
+        size_t errorLine = 1; // 1-based, relative to the chunk
+        size_t errorColumn = 1;
+        std::vector<std::string> callees;
+
+        std::vector<std::string> semanticErrors; // per function, empty when clean
+        std::vector<bool> duplicates;            // per function: an earlier one has the same name
+
+        bool queued = false; // diagnostics are out of date
+        bool reanalyze = false;
+    };
+
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    SemanticAnalyzer analyzer; // knows the signature each name resolves to
+    std::unordered_map<std::string, size_t> signatures;
+    std::unordered_map<std::string, std::vector<Chunk *>> declarers;
+    std::unordered_map<std::string, std::vector<Chunk *>> callers;
+    std::vector<Chunk *> queue;
+    size_t reparsedChunks = 0;
+    size_t analyzedChunks = 0;
+
+    struct Position
+    {
+        size_t chunk;
+        size_t offset;
+    };
+
+    static size_t utf16Units(unsigned char lead)
+    {
+        if ((lead & 0xC0) == 0x80)
+            return 0; // continuation byte
+        return lead >= 0xF0 ? 2 : 1;
+    }
+
+    static size_t utf16Length(const std::string &text, size_t begin, size_t end)
+    {
+        size_t units = 0;
+        for (size_t i = begin; i < end; i++)
+            units += utf16Units(static_cast<unsigned char>(text[i]));
+        return units;
+    }
+
+    static bool isIdentifierChar(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    // Whether `int name(` starts at `at`, given the character before it
+    static bool headerAt(const std::string &text, size_t at, char before)
+    {
+        if (isIdentifierChar(before) || text.compare(at, 3, "int") != 0)
+            return false;
+        size_t i = at + 3;
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i])))
+            i++;
+        if (i == at + 3 || i == text.size() || !(std::isalpha(static_cast<unsigned char>(text[i])) || text[i] == '_'))
+            return false;
+        while (i < text.size() && isIdentifierChar(text[i]))
+            i++;
+        while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i])))
+            i++;
+        return i < text.size() && text[i] == '(';
+    }
+
+    static const std::vector<std::unique_ptr<FunctionDeclaration>> &functionsOf(const Chunk &chunk)
+    {
+        static const std::vector<std::unique_ptr<FunctionDeclaration>> none;
+        return chunk.program ? static_cast<const Program *>(chunk.program.get())->functions : none;
+    }
+
+    static std::unique_ptr<Chunk> compileChunk(std::string text)
+    {
+        auto chunk = std::make_unique<Chunk>();
+        chunk->text = std::move(text);
+        chunk->newlines = static_cast<size_t>(std::count(chunk->text.begin(), chunk->text.end(), '\n'));
+        size_t tail = chunk->text.rfind('\n');
+        chunk->tailUnits = utf16Length(chunk->text, tail == std::string::npos ? 0 : tail + 1, chunk->text.size());
+        try
+        {
+            Lexer lexer(chunk->text);
+            chunk->tokens = lexer.tokenize();
+            Parser parser(chunk->tokens);
+            chunk->program = parser.parseProgram();
+        }
+        catch (const std::exception &e)
+        {
+            chunk->program.reset();
+            chunk->error = e.what();
+
+            // Lexer and parser messages end in " at line L, column C", relative
+            // to the chunk. The position goes into the diagnostic's range and is
+            // dropped from the text, which would otherwise name the wrong line.
+            size_t at = chunk->error.rfind(" at line ");
+            if (at != std::string::npos)
+            {
+                char *end;
+                chunk->errorLine = std::strtoul(chunk->error.c_str() + at + 9, &end, 10);
+                const char *column = std::strstr(end, "column ");
+                if (column)
+                    chunk->errorColumn = std::strtoul(column + 7, nullptr, 10);
+                chunk->error.erase(at);
+            }
+            return chunk;
+        }
+        chunk->semanticErrors.assign(functionsOf(*chunk).size(), std::string());
+        chunk->duplicates.assign(functionsOf(*chunk).size(), false);
+
+        // An identifier followed by '(' is a call unless it follows 'int'
+        const auto &tokens = chunk->tokens;
+        for (size_t i = 1; i + 1 < tokens.size(); i++)
+        {
+            if (tokens[i].type == TokenType::IDENTIFIER && tokens[i + 1].type == TokenType::LPAREN &&
+                tokens[i - 1].type != TokenType::INT &&
+                std::find(chunk->callees.begin(), chunk->callees.end(), tokens[i].value) == chunk->callees.end())
+                chunk->callees.push_back(tokens[i].value);
+        }
+        return chunk;
+    }
+
+    // Byte offset of an LSP position. The chunk list is walked adding up line
+    // counts; a position at the end of a chunk belongs to the next one.
+    Position find(size_t line, size_t character) const
+    {
+        size_t startLine = 0;
+        size_t startColumn = 0;
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            const Chunk &chunk = *chunks[i];
+            size_t endLine = startLine + chunk.newlines;
+            size_t endColumn = (chunk.newlines ? 0 : startColumn) + chunk.tailUnits;
+            if (line < endLine || (line == endLine && character < endColumn))
+            {
+                size_t offset = 0;
+                for (size_t l = startLine; l < line; l++)
+                    offset = chunk.text.find('\n', offset) + 1;
+                size_t units = line == startLine ? startColumn : 0;
+                for (; offset < chunk.text.size() && chunk.text[offset] != '\n'; offset++)
+                {
+                    size_t width = utf16Units(static_cast<unsigned char>(chunk.text[offset]));
+                    if (width != 0 && units >= character)
+                        break;
+                    units += width;
+                }
+                return {i, offset};
+            }
+            startLine = endLine;
+            startColumn = endColumn;
+        }
+        return {chunks.size() - 1, chunks.back()->text.size()};
+    }
+
+    void enqueue(Chunk *chunk, bool reanalyze)
+    {
+        chunk->reanalyze = chunk->reanalyze || reanalyze;
+        if (!chunk->queued)
+        {
+            chunk->queued = true;
+            queue.push_back(chunk);
+        }
+    }
+
+    static void unlink(std::unordered_map<std::string, std::vector<Chunk *>> &index, const std::string &name,
+                       Chunk *chunk)
+    {
+        auto it = index.find(name);
+        it->second.erase(std::find(it->second.begin(), it->second.end(), chunk));
+        if (it->second.empty())
+            index.erase(it);
+    }
+
+    // Adds or removes a chunk's declarations and calls, collecting the names
+    // whose declarations changed
+    void attach(Chunk *chunk, std::vector<std::string> &changed)
+    {
+        for (const auto &func : functionsOf(*chunk))
+        {
+            declarers[func->name].push_back(chunk);
+            changed.push_back(func->name);
+        }
+        for (const auto &callee : chunk->callees)
+            callers[callee].push_back(chunk);
+    }
+
+    void detach(Chunk *chunk, std::vector<std::string> &changed)
+    {
+        for (const auto &func : functionsOf(*chunk))
+        {
+            unlink(declarers, func->name, chunk);
+            changed.push_back(func->name);
+        }
+        for (const auto &callee : chunk->callees)
+            unlink(callers, callee, chunk);
+    }
+
+    // Settles which declaration of a name counts (the first one in the
+    // document) and queues whatever that changes: the duplicate flags of its
+    // declarers, and the callers when its arity moved
+    void resolve(const std::string &name)
+    {
+        long long arity = -1;
+        auto declared = declarers.find(name);
+        if (declared != declarers.end())
+        {
+            const auto &list = declared->second;
+            Chunk *winner = list.front();
+            if (list.size() > 1)
+            {
+                for (const auto &chunk : chunks)
+                {
+                    if (std::find(list.begin(), list.end(), chunk.get()) != list.end())
+                    {
+                        winner = chunk.get();
+                        break;
+                    }
+                }
+            }
+            for (Chunk *chunk : list)
+            {
+                const auto &functions = functionsOf(*chunk);
+                for (size_t f = 0; f < functions.size(); f++)
+                {
+                    if (functions[f]->name != name)
+                        continue;
+                    if (chunk == winner)
+                        arity = static_cast<long long>(functions[f]->parameters.size());
+                    if (chunk->duplicates[f] != (chunk != winner))
+                    {
+                        chunk->duplicates[f] = chunk != winner;
+                        enqueue(chunk, false);
+                    }
+                }
+            }
+        }
+
+        auto known = signatures.find(name);
+        long long previous = known == signatures.end() ? -1 : static_cast<long long>(known->second);
+        if (arity == previous)
+            return;
+        if (arity < 0)
+        {
+            signatures.erase(known);
+            analyzer.removeSignature(name);
+        }
+        else
+        {
+            signatures[name] = static_cast<size_t>(arity);
+            analyzer.declareSignature(name, static_cast<size_t>(arity));
+        }
+        auto calling = callers.find(name);
+        if (calling != callers.end())
+        {
+            for (Chunk *chunk : calling->second)
+                enqueue(chunk, true);
+        }
+    }
+
+    // Where to report a semantic error: the first token named in the message
+    // (errors quote the offending name), else the function name
+    static const Token *locate(const Chunk &chunk, const std::string &message, const std::string &function)
+    {
+        std::string name = function;
+        size_t open = message.find('\'');
+        size_t close = open == std::string::npos ? open : message.find('\'', open + 1);
+        if (close != std::string::npos)
+            name = message.substr(open + 1, close - open - 1);
+        for (const std::string &wanted : {name, function})
+        {
+            for (const auto &token : chunk.tokens)
+            {
+                if (token.type == TokenType::IDENTIFIER && token.value == wanted)
+                    return &token;
+            }
+        }
+        return nullptr;
+    }
+
+    // Diagnostic at a 1-based line and byte column of the chunk; characters
+    // on its first line count from the chunk start
+    static Diagnostic diagnosticAt(const Chunk &chunk, size_t line, size_t column, size_t length,
+                                   const std::string &message)
+    {
+        const std::string &text = chunk.text;
+        size_t lineStart = 0;
+        for (size_t l = 1; l < line && lineStart < text.size(); l++)
+        {
+            size_t newline = text.find('\n', lineStart);
+            lineStart = newline == std::string::npos ? text.size() : newline + 1;
+        }
+        size_t lineEnd = std::min(text.find('\n', lineStart), text.size());
+        size_t begin = std::min(lineStart + (column > 0 ? column - 1 : 0), lineEnd);
+        size_t end = std::min(begin + std::max<size_t>(1, length), lineEnd);
+
+        Diagnostic diagnostic;
+        diagnostic.line = line > 0 ? line - 1 : 0;
+        diagnostic.character = utf16Length(text, lineStart, begin);
+        diagnostic.endCharacter = std::max(diagnostic.character + 1, diagnostic.character + utf16Length(text, begin, end));
+        diagnostic.message = message;
+        return diagnostic;
+    }
+
+    void analyze(Chunk &chunk)
+    {
+        const auto &functions = functionsOf(chunk);
+        for (size_t f = 0; f < functions.size(); f++)
+        {
+            chunk.semanticErrors[f].clear();
+            try
+            {
+                analyzer.analyzeDeclaredFunction(functions[f].get());
+            }
+            catch (const SemanticError &error)
+            {
+                chunk.semanticErrors[f] = error.what();
+            }
+        }
+        analyzedChunks++;
+    }
+
+    void collectDiagnostics(Chunk &chunk)
+    {
+        chunk.diagnostics.clear();
+        if (!chunk.program)
+        {
+            chunk.diagnostics.push_back(diagnosticAt(chunk, chunk.errorLine, chunk.errorColumn, 1, chunk.error));
+            return;
+        }
+        const auto &functions = functionsOf(chunk);
+        for (size_t f = 0; f < functions.size(); f++)
+        {
+            std::string message = chunk.duplicates[f] ? "Function '" + functions[f]->name + "' is already declared"
+                                                       : chunk.semanticErrors[f];
+            if (message.empty())
+                continue;
+            const Token *token = locate(chunk, message, functions[f]->name);
+            chunk.diagnostics.push_back(token ? diagnosticAt(chunk, token->line, token->column, token->value.size(), message)
+                                              : diagnosticAt(chunk, 1, 1, 1, message));
+        }
+    }
+
+    // Replaces chunks [first, last) with the chunks of `region`, their text
+    // after the edit. The region grows by a neighbour when a boundary no
+    // longer falls on a header: at its start, the text then belongs to the
+    // chunk before; at its end, the next chunk's header was joined onto an
+    // identifier.
+    void rebuild(size_t first, size_t last, std::string region)
+    {
+        while (last < chunks.size() &&
+               !headerAt(chunks[last]->text, 0,
+                         !region.empty() ? region.back() : first > 0 ? chunks[first - 1]->text.back() : '\n'))
+            region += chunks[last++]->text;
+        if (first > 0 && !region.empty() && !headerAt(region, 0, chunks[first - 1]->text.back()))
+            region.insert(0, chunks[--first]->text);
+
+        std::vector<std::unique_ptr<Chunk>> created;
+        for (size_t begin = 0, i = 1; i <= region.size(); i++)
+        {
+            if (i == region.size() || headerAt(region, i, region[i - 1]))
+            {
+                created.push_back(compileChunk(region.substr(begin, i - begin)));
+                begin = i;
+            }
+        }
+        reparsedChunks = created.size();
+        analyzedChunks = 0;
+
+        std::vector<std::string> changed;
+        for (size_t i = first; i < last; i++)
+            detach(chunks[i].get(), changed);
+        for (auto &chunk : created)
+        {
+            attach(chunk.get(), changed);
+            enqueue(chunk.get(), true);
+        }
+
+        // Swap the new chunks in, moving the rest of the list only when the count changed
+        size_t kept = std::min(last - first, created.size());
+        std::move(created.begin(), created.begin() + static_cast<std::ptrdiff_t>(kept),
+                  chunks.begin() + static_cast<std::ptrdiff_t>(first));
+        auto tail = chunks.begin() + static_cast<std::ptrdiff_t>(first + kept);
+        if (created.size() > kept)
+            chunks.insert(tail, std::make_move_iterator(created.begin() + static_cast<std::ptrdiff_t>(kept)),
+                          std::make_move_iterator(created.end()));
+        else
+            chunks.erase(tail, tail + static_cast<std::ptrdiff_t>(last - first - kept));
+
+        for (const auto &name : changed)
+            resolve(name);
+        for (Chunk *chunk : queue)
+        {
+            if (chunk->reanalyze)
+                analyze(*chunk);
+            collectDiagnostics(*chunk);
+            chunk->queued = chunk->reanalyze = false;
+        }
+        queue.clear();
+    }
+
+public:
+    // Chunks lexed and parsed, and chunks analyzed, by the last edit
+    size_t getReparsedChunks() const { return reparsedChunks; }
+    size_t getAnalyzedChunks() const { return analyzedChunks; }
+
+    void setText(std::string text)
+    {
+        chunks.clear();
+        analyzer.reset();
+        signatures.clear();
+        declarers.clear();
+        callers.clear();
+        rebuild(0, 0, std::move(text));
+    }
+
+    // Applies one LSP range edit
+    void replace(size_t startLine, size_t startCharacter, size_t endLine, size_t endCharacter,
+                 const std::string &newText)
+    {
+        if (chunks.empty())
+        {
+            rebuild(0, 0, newText);
+            return;
+        }
+        Position start = find(startLine, startCharacter);
+        Position end = find(endLine, endCharacter);
+        if (end.chunk < start.chunk || (end.chunk == start.chunk && end.offset < start.offset))
+            end = start;
+        rebuild(start.chunk, end.chunk + 1,
+                chunks[start.chunk]->text.substr(0, start.offset) + newText + chunks[end.chunk]->text.substr(end.offset));
+    }
+
+    // Every chunk's diagnostics, moved to the chunk's place in the document
+    std::vector<Diagnostic> diagnose() const
+    {
+        std::vector<Diagnostic> diagnostics;
+        size_t line = 0;
+        size_t column = 0;
+        for (const auto &chunk : chunks)
+        {
+            for (Diagnostic diagnostic : chunk->diagnostics)
+            {
+                if (diagnostic.line == 0)
+                {
+                    diagnostic.character += column;
+                    diagnostic.endCharacter += column;
+                }
+                diagnostic.line += line;
+                diagnostics.push_back(std::move(diagnostic));
+            }
+            column = (chunk->newlines ? 0 : column) + chunk->tailUnits;
+            line += chunk->newlines;
+        }
+        return diagnostics;
+    }
+};
+
+// Language server over the LSP base protocol (Content-Length framed
+// JSON-RPC) on a pair of streams. Documents are synchronized incrementally
+// and diagnostics are published after every change.
+class LanguageServer
+{
+private:
+    std::istream &in;
+    std::ostream &out;
+    std::unordered_map<std::string, DocumentModel> documents;
+    bool shutdownRequested = false;
+
+    bool readMessage(std::string &body)
+    {
+        size_t length = 0;
+        bool haveLength = false;
+        std::string header;
+        while (std::getline(in, header))
+        {
+            if (!header.empty() && header.back() == '\r')
+                header.pop_back();
+            if (header.empty())
+            {
+                if (!haveLength)
+                    continue;
+                body.resize(length);
+                return length == 0 || static_cast<bool>(in.read(&body[0], static_cast<std::streamsize>(length)));
+            }
+            if (header.compare(0, 15, "Content-Length:") == 0)
+            {
+                length = std::strtoul(header.c_str() + 15, nullptr, 10);
+                haveLength = true;
+            }
+        }
+        return false;
+    }
+
+    void send(const JsonValue &message)
+    {
+        std::string body = message.dump();
+        out << "Content-Length: " << body.size() << "\r\n\r\n"
+            << body;
+        out.flush();
+    }
+
+    void respond(const JsonValue &id, JsonValue result)
+    {
+        JsonValue message = JsonValue::object();
+        message.set("jsonrpc", "2.0").set("id", id).set("result", std::move(result));
+        send(message);
+    }
+
+    void respondError(const JsonValue &id, int code, const std::string &text)
+    {
+        JsonValue error = JsonValue::object();
+        error.set("code", code).set("message", text);
+        JsonValue message = JsonValue::object();
+        message.set("jsonrpc", "2.0").set("id", id).set("error", std::move(error));
+        send(message);
+    }
+
+    static JsonValue position(size_t line, size_t character)
+    {
+        JsonValue value = JsonValue::object();
+        value.set("line", line).set("character", character);
+        return value;
+    }
+
+    void publish(const std::string &uri, const JsonValue &version, const std::vector<Diagnostic> &diagnostics)
+    {
+        JsonValue list = JsonValue::array();
+        for (const auto &diagnostic : diagnostics)
+        {
+            JsonValue range = JsonValue::object();
+            range.set("start", position(diagnostic.line, diagnostic.character));
+            range.set("end", position(diagnostic.line, diagnostic.endCharacter));
+            JsonValue item = JsonValue::object();
+            item.set("range", std::move(range)).set("severity", 1).set("source", "coulstock");
+            item.set("message", diagnostic.message);
+            list.push(std::move(item));
+        }
+
+        JsonValue params = JsonValue::object();
+        params.set("uri", uri);
+        if (!version.isNull())
+            params.set("version", version);
+        params.set("diagnostics", std::move(list));
+        JsonValue message = JsonValue::object();
+        message.set("jsonrpc", "2.0").set("method", "textDocument/publishDiagnostics").set("params", std::move(params));
+        send(message);
+    }
+
+    static size_t number(const JsonValue &value)
+    {
+        return value.isNumber() && value.asNumber() > 0 ? static_cast<size_t>(value.asNumber()) : 0;
+    }
+
+    void didChange(const JsonValue &params)
+    {
+        const JsonValue &textDocument = params["textDocument"];
+        auto it = documents.find(textDocument["uri"].asString());
+        if (it == documents.end())
+            return;
+        DocumentModel &model = it->second;
+        for (const auto &change : params["contentChanges"].asArray())
+        {
+            const JsonValue &range = change["range"];
+            if (range.isNull())
+            {
+                model.setText(change["text"].asString());
+                continue;
+            }
+            const JsonValue &start = range["start"];
+            const JsonValue &end = range["end"];
+            model.replace(number(start["line"]), number(start["character"]), number(end["line"]),
+                          number(end["character"]), change["text"].asString());
+        }
+        publish(it->first, textDocument["version"], model.diagnose());
+    }
+
+    // Returns false once the client sent `exit`
+    bool handle(const JsonValue &message)
+    {
+        const std::string &method = message["method"].asString();
+        const JsonValue &id = message["id"];
+        const JsonValue &params = message["params"];
+        bool isRequest = !id.isNull();
+
+        if (method == "initialize")
+        {
+            JsonValue sync = JsonValue::object();
+            sync.set("openClose", true).set("change", 2); // incremental
+            JsonValue capabilities = JsonValue::object();
+            capabilities.set("textDocumentSync", std::move(sync));
+            JsonValue info = JsonValue::object();
+            info.set("name", "coulstock");
+            JsonValue result = JsonValue::object();
+            result.set("capabilities", std::move(capabilities)).set("serverInfo", std::move(info));
+            respond(id, std::move(result));
+        }
+        else if (method == "shutdown")
+        {
+            shutdownRequested = true;
+            respond(id, JsonValue());
+        }
+        else if (method == "exit")
+        {
+            return false;
+        }
+        else if (method == "textDocument/didOpen")
+        {
+            const JsonValue &textDocument = params["textDocument"];
+            const std::string &uri = textDocument["uri"].asString();
+            DocumentModel &model = documents[uri];
+            model.setText(textDocument["text"].asString());
+            publish(uri, textDocument["version"], model.diagnose());
+        }
+        else if (method == "textDocument/didChange")
+        {
+            didChange(params);
+        }
+        else if (method == "textDocument/didClose")
+        {
+            const std::string &uri = params["textDocument"]["uri"].asString();
+            documents.erase(uri);
+            publish(uri, JsonValue(), {});
+        }
+        else if (isRequest)
+        {
+            respondError(id, -32601, "Method not found: " + method);
+        }
+        return true;
+    }
+
+public:
+    LanguageServer(std::istream &in, std::ostream &out) : in(in), out(out) {}
+
+    // Serves until `exit`; the exit code follows the LSP rule (0 only after shutdown)
+    int run()
+    {
+        std::string body;
+        while (readMessage(body))
+        {
+            JsonValue message;
+            try
+            {
+                message = JsonValue::parse(body);
+            }
+            catch (const std::exception &e)
+            {
+                respondError(JsonValue(), -32700, e.what());
+                continue;
+            }
+            try
+            {
+                if (!handle(message))
+                    return shutdownRequested ? 0 : 1;
+            }
+            catch (const std::exception &e)
+            {
+                if (!message["id"].isNull())
+                    respondError(message["id"], -32603, e.what());
+            }
+        }
+        return shutdownRequested ? 0 : 1;
+    }
+};
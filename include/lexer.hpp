@@ -35,6 +35,9 @@ enum class TokenType
     RPAREN, // ( )
     LBRACE,
     RBRACE, // { }
+    LBRACKET,
+    RBRACKET, // [ ]
+    COMMA,
     SEMICOLON,
     EOF_TOKEN,
 };
@@ -80,6 +83,17 @@ private:
         return current;
     }
 
+    // A character for an error message; bytes that are not printable ASCII
+    // (such as part of a UTF-8 sequence) are shown as \xHH
+    static std::string describe(char c)
+    {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (byte > 0x20 && byte < 0x7F)
+            return std::string(1, c);
+        const char *digits = "0123456789ABCDEF";
+        return std::string("\\x") + digits[byte >> 4] + digits[byte & 0xF];
+    }
+
     char peekNext() const
     {
         if (position + 1 >= input.length())
@@ -89,7 +103,7 @@ private:
 
     void skipWhitespace()
     {
-        while (std::isspace(peek()))
+        while (std::isspace(static_cast<unsigned char>(peek())))
         {
             advance();
         }
@@ -100,7 +114,7 @@ private:
         std::string result;
         int startColumn = column;
 
-        while (std::isdigit(peek()) || peek() == '.')
+        while (std::isdigit(static_cast<unsigned char>(peek())) || peek() == '.')
         {
             result += advance();
         }
@@ -113,7 +127,7 @@ private:
         std::string result;
         int startColumn = column;
 
-        while (std::isalnum(peek()) || peek() == '_')
+        while (std::isalnum(static_cast<unsigned char>(peek())) || peek() == '_')
         {
             result += advance();
         }
@@ -131,6 +145,15 @@ private:
 public:
     explicit Lexer(std::string source) : input(std::move(source)) {}
 
+    // Starts over on a new source, reusing the input buffer
+    void reset(const std::string &source)
+    {
+        input.assign(source);
+        position = 0;
+        line = 1;
+        column = 1;
+    }
+
     Token nextToken()
     {
         skipWhitespace();
@@ -144,13 +167,13 @@ public:
         int currentColumn = column;
 
         // Handle numbers
-        if (std::isdigit(current))
+        if (std::isdigit(static_cast<unsigned char>(current)))
         {
             return readNumber();
         }
 
         // Handle identifiers and keywords
-        if (std::isalpha(current) || current == '_')
+        if (std::isalpha(static_cast<unsigned char>(current)) || current == '_')
         {
             return readIdentifier();
         }
@@ -176,6 +199,12 @@ public:
             return Token(TokenType::LBRACE, "{", line, currentColumn);
         case '}':
             return Token(TokenType::RBRACE, "}", line, currentColumn);
+        case '[':
+            return Token(TokenType::LBRACKET, "[", line, currentColumn);
+        case ']':
+            return Token(TokenType::RBRACKET, "]", line, currentColumn);
+        case ',':
+            return Token(TokenType::COMMA, ",", line, currentColumn);
         case ';':
             return Token(TokenType::SEMICOLON, ";", line, currentColumn);
         case '=':
@@ -200,20 +229,27 @@ public:
             }
             return Token(TokenType::LESS, "<", line, currentColumn);
         default:
-            throw std::runtime_error("Unexpected character: " + std::string(1, current));
+            throw std::runtime_error("Unexpected character: " + describe(current) + " at line " +
+                                     std::to_string(line) + ", column " + std::to_string(currentColumn));
         }
     }
 
     std::vector<Token> tokenize()
     {
         std::vector<Token> tokens;
+        tokenize(tokens);
+        return tokens;
+    }
+
+    // Replaces the contents of `tokens`, keeping its capacity
+    void tokenize(std::vector<Token> &tokens)
+    {
+        tokens.clear();
         while (true)
         {
-            Token token = nextToken();
-            tokens.push_back(token);
-            if (token.type == TokenType::EOF_TOKEN)
+            tokens.push_back(nextToken());
+            if (tokens.back().type == TokenType::EOF_TOKEN)
                 break;
         }
-        return tokens;
     }
 };
\ No newline at end of file
@@ -0,0 +1,598 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include "parser.hpp"
+
+// Compiled module file layout. Every offset is relative to the start of the
+// file, and the header and tables are fixed-width so a mapped file can be
+// read in place; node encodings use LEB128 varints.
+//
+//   Header          magic "CSMD", version, counts and table offsets
+//   String table    stringCount x {offset, length} into the string data
+//   Number pool     numberCount x 8-byte double
+//   Function table  functionCount x {name, parameter count, code offset, code size}
+//   String data     concatenated names
+//   Code            one pre-order node encoding per function
+namespace module_format
+{
+    constexpr char MAGIC[4] = {'C', 'S', 'M', 'D'};
+    constexpr uint32_t VERSION = 2;
+    constexpr size_t MAX_NESTING = 4096; // deepest node nesting the reader follows
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t stringCount;
+        uint32_t numberCount;
+        uint32_t functionCount;
+        uint32_t stringTableOffset;
+        uint32_t numberPoolOffset;
+        uint32_t functionTableOffset;
+        uint32_t stringDataOffset;
+        uint32_t codeOffset;
+        uint32_t fileSize;
+    };
+
+    struct StringEntry
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct FunctionEntry
+    {
+        uint32_t name;
+        uint32_t parameterCount;
+        uint32_t codeOffset;
+        uint32_t codeSize;
+    };
+}
+
+// Serializes an analyzed (and optionally optimized) program
+class ModuleWriter
+{
+private:
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint32_t> stringIndex;
+    std::vector<double> numbers;
+    std::unordered_map<uint64_t, uint32_t> numberIndex; // keyed by bit pattern
+    std::vector<uint8_t> code;
+
+    uint32_t internString(const std::string &value)
+    {
+        auto it = stringIndex.find(value);
+        if (it != stringIndex.end())
+            return it->second;
+        uint32_t index = static_cast<uint32_t>(strings.size());
+        strings.push_back(value);
+        stringIndex.emplace(value, index);
+        return index;
+    }
+
+    uint32_t internNumber(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        auto it = numberIndex.find(bits);
+        if (it != numberIndex.end())
+            return it->second;
+        uint32_t index = static_cast<uint32_t>(numbers.size());
+        numbers.push_back(value);
+        numberIndex.emplace(bits, index);
+        return index;
+    }
+
+    void writeVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            code.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        code.push_back(static_cast<uint8_t>(value));
+    }
+
+    void writeByte(uint8_t value) { code.push_back(value); }
+
+    void writeExpression(const Expression *expr)
+    {
+        writeByte(static_cast<uint8_t>(expr->getType()));
+        switch (expr->getType())
+        {
+        case NodeType::NumberExpr:
+            writeVarint(internNumber(static_cast<const NumberExpression *>(expr)->value));
+            break;
+        case NodeType::IdentifierExpr:
+            writeVarint(internString(static_cast<const IdentifierExpression *>(expr)->name));
+            break;
+        case NodeType::BinaryExpr:
+        {
+            auto *binary = static_cast<const BinaryExpression *>(expr);
+            writeByte(static_cast<uint8_t>(binary->op));
+            if (binary->op == TokenType::DIVIDE)
+                writeByte(binary->divisionCheck ? 1 : 0);
+            writeExpression(binary->left.get());
+            writeExpression(binary->right.get());
+            break;
+        }
+        case NodeType::CallExpr:
+        {
+            auto *call = static_cast<const CallExpression *>(expr);
+            writeVarint(internString(call->callee));
+            writeByte(static_cast<uint8_t>(call->tailCall));
+            writeVarint(call->arguments.size());
+            for (const auto &arg : call->arguments)
+                writeExpression(arg.get());
+            break;
+        }
+        case NodeType::IndexExpr:
+        {
+            auto *index = static_cast<const IndexExpression *>(expr);
+            writeVarint(internString(index->array));
+            writeByte(index->boundsCheck ? 1 : 0);
+            writeExpression(index->index.get());
+            break;
+        }
+        default:
+            throw std::runtime_error("Cannot serialize expression node");
+        }
+    }
+
+    void writeStatement(const Statement *stmt)
+    {
+        writeByte(static_cast<uint8_t>(stmt->getType()));
+        switch (stmt->getType())
+        {
+        case NodeType::VarDecl:
+        {
+            auto *varDecl = static_cast<const VariableDeclaration *>(stmt);
+            writeVarint(internString(varDecl->name));
+            writeExpression(varDecl->initializer.get());
+            break;
+        }
+        case NodeType::ArrayDecl:
+        {
+            auto *arrayDecl = static_cast<const ArrayDeclaration *>(stmt);
+            writeVarint(internString(arrayDecl->name));
+            writeVarint(arrayDecl->size);
+            break;
+        }
+        case NodeType::AssignStmt:
+        {
+            auto *assign = static_cast<const AssignmentStatement *>(stmt);
+            writeExpression(assign->target.get());
+            writeExpression(assign->value.get());
+            break;
+        }
+        case NodeType::ReturnStmt:
+            writeExpression(static_cast<const ReturnStatement *>(stmt)->value.get());
+            break;
+        case NodeType::IfStmt:
+        {
+            auto *ifStmt = static_cast<const IfStatement *>(stmt);
+            writeByte(static_cast<uint8_t>(ifStmt->hint));
+            writeByte(ifStmt->elseBranch ? 1 : 0);
+            writeExpression(ifStmt->condition.get());
+            writeStatement(ifStmt->thenBranch.get());
+            if (ifStmt->elseBranch)
+                writeStatement(ifStmt->elseBranch.get());
+            break;
+        }
+        case NodeType::BlockStmt:
+        {
+            auto *block = static_cast<const BlockStatement *>(stmt);
+            writeVarint(block->statements.size());
+            for (const auto &s : block->statements)
+                writeStatement(s.get());
+            break;
+        }
+        default:
+            throw std::runtime_error("Cannot serialize statement node");
+        }
+    }
+
+    template <typename T>
+    static void append(std::vector<uint8_t> &out, const T &value)
+    {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+public:
+    std::vector<uint8_t> write(const Program &program)
+    {
+        std::vector<uint8_t> out;
+        write(program, out);
+        return out;
+    }
+
+    // Replaces the contents of `out`. A writer can be reused for many
+    // programs; its tables and buffers keep their capacity between writes.
+    void write(const Program &program, std::vector<uint8_t> &out)
+    {
+        strings.clear();
+        stringIndex.clear();
+        numbers.clear();
+        numberIndex.clear();
+        code.clear();
+
+        std::vector<module_format::FunctionEntry> functions;
+        for (const auto &func : program.functions)
+        {
+            module_format::FunctionEntry entry;
+            entry.name = internString(func->name);
+            entry.parameterCount = static_cast<uint32_t>(func->parameters.size());
+            entry.codeOffset = static_cast<uint32_t>(code.size());
+            for (const auto &param : func->parameters)
+                writeVarint(internString(param));
+            writeStatement(func->body.get());
+            entry.codeSize = static_cast<uint32_t>(code.size()) - entry.codeOffset;
+            functions.push_back(entry);
+        }
+
+        std::string stringData;
+        std::vector<module_format::StringEntry> stringTable;
+        for (const auto &value : strings)
+        {
+            stringTable.push_back({static_cast<uint32_t>(stringData.size()), static_cast<uint32_t>(value.size())});
+            stringData += value;
+        }
+
+        module_format::Header header;
+        std::memcpy(header.magic, module_format::MAGIC, sizeof(header.magic));
+        header.version = module_format::VERSION;
+        header.stringCount = static_cast<uint32_t>(strings.size());
+        header.numberCount = static_cast<uint32_t>(numbers.size());
+        header.functionCount = static_cast<uint32_t>(functions.size());
+        header.stringTableOffset = sizeof(header);
+        header.numberPoolOffset = header.stringTableOffset + header.stringCount * sizeof(module_format::StringEntry);
+        header.functionTableOffset = header.numberPoolOffset + header.numberCount * sizeof(double);
+        header.stringDataOffset = header.functionTableOffset + header.functionCount * sizeof(module_format::FunctionEntry);
+        header.codeOffset = header.stringDataOffset + static_cast<uint32_t>(stringData.size());
+        header.fileSize = header.codeOffset + static_cast<uint32_t>(code.size());
+
+        out.clear();
+        out.reserve(header.fileSize);
+        append(out, header);
+        for (const auto &entry : stringTable)
+            append(out, entry);
+        for (double value : numbers)
+            append(out, value);
+        for (const auto &entry : functions)
+            append(out, entry);
+        out.insert(out.end(), stringData.begin(), stringData.end());
+        out.insert(out.end(), code.begin(), code.end());
+    }
+
+    void writeFile(const Program &program, const std::string &path)
+    {
+        std::vector<uint8_t> bytes = write(program);
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!file)
+            throw std::runtime_error("Cannot write module file '" + path + "'");
+    }
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+    void *data = nullptr;
+    size_t length = 0;
+
+public:
+    explicit MappedFile(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open module file '" + path + "'");
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Cannot read module file '" + path + "'");
+        }
+        length = static_cast<size_t>(info.st_size);
+        data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            throw std::runtime_error("Cannot map module file '" + path + "'");
+    }
+
+    ~MappedFile() { ::munmap(data, length); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *bytes() const { return static_cast<const uint8_t *>(data); }
+    size_t size() const { return length; }
+};
+
+// Reads a module in place from a buffer (typically a MappedFile). Functions
+// are decoded on demand, so a caller that needs one function pays for one.
+class ModuleReader
+{
+private:
+    const uint8_t *data;
+    size_t size;
+    module_format::Header header;
+
+    // Decoding position within one function's code
+    const uint8_t *cursor = nullptr;
+    const uint8_t *end = nullptr;
+
+    [[noreturn]] static void malformed(const std::string &what)
+    {
+        throw std::runtime_error("Malformed module: " + what);
+    }
+
+    template <typename T>
+    T readTableEntry(uint32_t tableOffset, uint32_t index) const
+    {
+        T entry;
+        std::memcpy(&entry, data + tableOffset + index * sizeof(T), sizeof(T));
+        return entry;
+    }
+
+    uint8_t readByte()
+    {
+        if (cursor >= end)
+            malformed("unexpected end of function code");
+        return *cursor++;
+    }
+
+    uint64_t readVarint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            uint8_t byte = readByte();
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        malformed("varint too long");
+    }
+
+    std::string readString()
+    {
+        uint64_t index = readVarint();
+        if (index > UINT32_MAX)
+            malformed("string index out of range");
+        return string(static_cast<uint32_t>(index));
+    }
+
+    // Enum bytes are checked before the cast, so only values the AST can
+    // hold are carried into it
+    TokenType readOperator()
+    {
+        auto op = static_cast<TokenType>(readByte());
+        switch (op)
+        {
+        case TokenType::PLUS:
+        case TokenType::MINUS:
+        case TokenType::MULTIPLY:
+        case TokenType::DIVIDE:
+        case TokenType::EQUAL:
+        case TokenType::NOT_EQUAL:
+        case TokenType::LESS:
+        case TokenType::GREATER:
+        case TokenType::GREATER_EQUAL:
+        case TokenType::LESS_EQUAL:
+            return op;
+        default:
+            malformed("unknown binary operator");
+        }
+    }
+
+    TailCall readTailCall()
+    {
+        uint8_t byte = readByte();
+        if (byte > static_cast<uint8_t>(TailCall::Sibling))
+            malformed("unknown tail call kind");
+        return static_cast<TailCall>(byte);
+    }
+
+    BranchHint readBranchHint()
+    {
+        uint8_t byte = readByte();
+        if (byte > static_cast<uint8_t>(BranchHint::Unlikely))
+            malformed("unknown branch hint");
+        return static_cast<BranchHint>(byte);
+    }
+
+    // `depth` counts the enclosing nodes, so a crafted module cannot recurse
+    // the reader off the end of its stack
+    static void checkDepth(size_t depth)
+    {
+        if (depth > module_format::MAX_NESTING)
+            malformed("nodes nested too deeply");
+    }
+
+    std::unique_ptr<Expression> readExpression(size_t depth)
+    {
+        checkDepth(depth);
+        auto type = static_cast<NodeType>(readByte());
+        switch (type)
+        {
+        case NodeType::NumberExpr:
+        {
+            uint64_t index = readVarint();
+            if (index >= header.numberCount)
+                malformed("number index out of range");
+            double value;
+            std::memcpy(&value, data + header.numberPoolOffset + index * sizeof(double), sizeof(value));
+            return std::make_unique<NumberExpression>(value);
+        }
+        case NodeType::IdentifierExpr:
+            return std::make_unique<IdentifierExpression>(readString());
+        case NodeType::BinaryExpr:
+        {
+            auto op = readOperator();
+            bool divisionCheck = op == TokenType::DIVIDE ? readByte() != 0 : true;
+            auto left = readExpression(depth + 1);
+            auto right = readExpression(depth + 1);
+            auto binary = std::make_unique<BinaryExpression>(std::move(left), op, std::move(right));
+            binary->divisionCheck = divisionCheck;
+            return binary;
+        }
+        case NodeType::CallExpr:
+        {
+            std::string callee = readString();
+            auto tailCall = readTailCall();
+            uint64_t count = readVarint();
+            std::vector<std::unique_ptr<Expression>> arguments;
+            for (uint64_t i = 0; i < count; i++)
+                arguments.push_back(readExpression(depth + 1));
+            auto call = std::make_unique<CallExpression>(std::move(callee), std::move(arguments));
+            call->tailCall = tailCall;
+            return call;
+        }
+        case NodeType::IndexExpr:
+            return readIndex(depth);
+        default:
+            malformed("unknown expression node");
+        }
+    }
+
+    std::unique_ptr<IndexExpression> readIndex(size_t depth)
+    {
+        std::string array = readString();
+        bool boundsCheck = readByte() != 0;
+        auto index = std::make_unique<IndexExpression>(std::move(array), readExpression(depth + 1));
+        index->boundsCheck = boundsCheck;
+        return index;
+    }
+
+    std::unique_ptr<Statement> readStatement(size_t depth)
+    {
+        checkDepth(depth);
+        auto type = static_cast<NodeType>(readByte());
+        switch (type)
+        {
+        case NodeType::VarDecl:
+        {
+            std::string name = readString();
+            return std::make_unique<VariableDeclaration>(std::move(name), readExpression(depth + 1));
+        }
+        case NodeType::ArrayDecl:
+        {
+            std::string name = readString();
+            uint64_t size = readVarint();
+            if (size == 0)
+                malformed("array of size 0");
+            return std::make_unique<ArrayDeclaration>(std::move(name), static_cast<size_t>(size));
+        }
+        case NodeType::AssignStmt:
+        {
+            if (readByte() != static_cast<uint8_t>(NodeType::IndexExpr))
+                malformed("assignment target is not an array element");
+            auto target = readIndex(depth + 1);
+            return std::make_unique<AssignmentStatement>(std::move(target), readExpression(depth + 1));
+        }
+        case NodeType::ReturnStmt:
+            return std::make_unique<ReturnStatement>(readExpression(depth + 1));
+        case NodeType::IfStmt:
+        {
+            auto hint = readBranchHint();
+            bool hasElse = readByte() != 0;
+            auto condition = readExpression(depth + 1);
+            auto thenBranch = readStatement(depth + 1);
+            auto elseBranch = hasElse ? readStatement(depth + 1) : nullptr;
+            auto ifStmt = std::make_unique<IfStatement>(std::move(condition), std::move(thenBranch),
+                                                        std::move(elseBranch));
+            ifStmt->hint = hint;
+            return ifStmt;
+        }
+        case NodeType::BlockStmt:
+        {
+            uint64_t count = readVarint();
+            std::vector<std::unique_ptr<Statement>> statements;
+            for (uint64_t i = 0; i < count; i++)
+                statements.push_back(readStatement(depth + 1));
+            return std::make_unique<BlockStatement>(std::move(statements));
+        }
+        default:
+            malformed("unknown statement node");
+        }
+    }
+
+public:
+    ModuleReader(const uint8_t *data, size_t size) : data(data), size(size)
+    {
+        if (size < sizeof(header))
+            malformed("file too small");
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, module_format::MAGIC, sizeof(header.magic)) != 0)
+            malformed("bad magic");
+        if (header.version != module_format::VERSION)
+            throw std::runtime_error("Unsupported module version " + std::to_string(header.version));
+        if (header.fileSize != size ||
+            header.stringTableOffset + uint64_t(header.stringCount) * sizeof(module_format::StringEntry) > size ||
+            header.numberPoolOffset + uint64_t(header.numberCount) * sizeof(double) > size ||
+            header.functionTableOffset + uint64_t(header.functionCount) * sizeof(module_format::FunctionEntry) > size ||
+            header.stringDataOffset > size || header.codeOffset > size)
+            malformed("table out of range");
+    }
+
+    explicit ModuleReader(const MappedFile &file) : ModuleReader(file.bytes(), file.size()) {}
+
+    size_t functionCount() const { return header.functionCount; }
+
+    std::string string(uint32_t index) const
+    {
+        if (index >= header.stringCount)
+            malformed("string index out of range");
+        auto entry = readTableEntry<module_format::StringEntry>(header.stringTableOffset, index);
+        if (uint64_t(header.stringDataOffset) + entry.offset + entry.length > header.codeOffset)
+            malformed("string out of range");
+        return std::string(reinterpret_cast<const char *>(data + header.stringDataOffset + entry.offset),
+                           entry.length);
+    }
+
+    std::string functionName(size_t index) const
+    {
+        if (index >= header.functionCount)
+            throw std::out_of_range("Function index out of range");
+        return string(readTableEntry<module_format::FunctionEntry>(header.functionTableOffset,
+                                                                   static_cast<uint32_t>(index)).name);
+    }
+
+    std::unique_ptr<FunctionDeclaration> loadFunction(size_t index)
+    {
+        if (index >= header.functionCount)
+            throw std::out_of_range("Function index out of range");
+        auto entry = readTableEntry<module_format::FunctionEntry>(header.functionTableOffset,
+                                                                  static_cast<uint32_t>(index));
+        if (uint64_t(header.codeOffset) + entry.codeOffset + entry.codeSize > size)
+            malformed("function entry out of range");
+
+        cursor = data + header.codeOffset + entry.codeOffset;
+        end = cursor + entry.codeSize;
+        std::vector<std::string> params;
+        for (uint32_t i = 0; i < entry.parameterCount; i++)
+            params.push_back(readString());
+        auto body = readStatement(0);
+        return std::make_unique<FunctionDeclaration>(string(entry.name), std::move(params), std::move(body));
+    }
+
+    std::unique_ptr<Program> load()
+    {
+        std::vector<std::unique_ptr<FunctionDeclaration>> functions;
+        for (size_t i = 0; i < header.functionCount; i++)
+            functions.push_back(loadFunction(i));
+        return std::make_unique<Program>(std::move(functions));
+    }
+};
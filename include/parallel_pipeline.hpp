@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pass_manager.hpp"
+
+// Runs an optimization pipeline over every function of a program on a pool
+// of worker threads. Passes keep per-run state, so each function gets its
+// own pipeline from the factory. Functions only touch their own subtree, and
+// statistics are merged in source order afterwards, so the result does not
+// depend on the number of threads or on scheduling.
+class ParallelPipeline
+{
+private:
+    std::function<PassManager()> makePipeline;
+    unsigned threadCount;
+    std::vector<PassStatistics> statistics;
+    TraceRecorder *trace = nullptr;
+
+public:
+    ParallelPipeline(std::function<PassManager()> makePipeline, unsigned threadCount)
+        : makePipeline(std::move(makePipeline)), threadCount(std::max(1u, threadCount)) {}
+
+    // Records a span per function and per pass; null disables tracing
+    void setTrace(TraceRecorder *recorder) { trace = recorder; }
+
+    void run(Program &program)
+    {
+        auto &functions = program.functions;
+        std::vector<std::vector<PassStatistics>> functionStats(functions.size());
+        std::vector<std::exception_ptr> errors(functions.size());
+
+        // Workers claim the next unprocessed function until none are left
+        std::atomic<size_t> next{0};
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < functions.size(); i = next++)
+            {
+                try
+                {
+                    auto start = TraceRecorder::Clock::now();
+                    PassManager pipeline = makePipeline();
+                    pipeline.setTrace(trace);
+                    pipeline.run(*functions[i]);
+                    functionStats[i] = pipeline.getStatistics();
+                    if (trace)
+                        trace->record(functions[i]->name, "function", start);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+
+        size_t workers = std::min<size_t>(threadCount, functions.size());
+        if (workers <= 1)
+        {
+            worker();
+        }
+        else
+        {
+            std::vector<std::thread> pool;
+            for (size_t t = 0; t < workers; t++)
+            {
+                pool.emplace_back([&, t]()
+                                  {
+                                      if (trace)
+                                          trace->nameThread("optimizer worker " + std::to_string(t));
+                                      worker(); });
+            }
+            for (auto &thread : pool)
+                thread.join();
+        }
+
+        // Report the first failure in source order, as a serial run would
+        for (const auto &error : errors)
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+        statistics.clear();
+        for (const auto &stats : functionStats)
+            mergeStatistics(statistics, stats);
+    }
+
+    void run(Statement *root)
+    {
+        if (root->getType() == NodeType::Program)
+        {
+            run(*static_cast<Program *>(root));
+        }
+        else if (root->getType() == NodeType::FunctionDecl)
+        {
+            PassManager pipeline = makePipeline();
+            pipeline.setTrace(trace);
+            pipeline.run(*static_cast<FunctionDeclaration *>(root));
+            statistics = pipeline.getStatistics();
+        }
+    }
+
+    const std::vector<PassStatistics> &getStatistics() const { return statistics; }
+};
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <cstdlib>
 #include <memory>
 #include <vector>
 #include "lexer.hpp"
@@ -15,10 +17,15 @@ enum class NodeType
     BinaryExpr,
     NumberExpr,
     IdentifierExpr,
+    CallExpr,
+    IndexExpr,
 
     // Statements
+    Program,
     FunctionDecl,
     VarDecl,
+    ArrayDecl,
+    AssignStmt,
     ReturnStmt,
     IfStmt,
     BlockStmt
@@ -51,6 +58,7 @@ public:
     std::unique_ptr<Expression> left;
     TokenType op;
     std::unique_ptr<Expression> right;
+    bool divisionCheck = true; // DIVIDE only: trap on a zero divisor or INT_MIN / -1
 };
 
 // Number literal
@@ -75,6 +83,42 @@ public:
     std::string name;
 };
 
+// Tail position of a call, filled in by the parser for `return f(...)`
+enum class TailCall
+{
+    None,
+    Self,   // call to the enclosing function
+    Sibling // call to another function
+};
+
+// Function call (e.g., f(a, b))
+class CallExpression : public Expression
+{
+public:
+    CallExpression(std::string callee, std::vector<std::unique_ptr<Expression>> arguments)
+        : callee(std::move(callee)), arguments(std::move(arguments)) {}
+
+    NodeType getType() const override { return NodeType::CallExpr; }
+
+    std::string callee;
+    std::vector<std::unique_ptr<Expression>> arguments;
+    TailCall tailCall = TailCall::None;
+};
+
+// Array element access (e.g., a[i])
+class IndexExpression : public Expression
+{
+public:
+    IndexExpression(std::string array, std::unique_ptr<Expression> index)
+        : array(std::move(array)), index(std::move(index)) {}
+
+    NodeType getType() const override { return NodeType::IndexExpr; }
+
+    std::string array;
+    std::unique_ptr<Expression> index;
+    bool boundsCheck = true; // cleared when the index is proven in range
+};
+
 // Statement base class
 class Statement : public ASTNode
 {
@@ -97,6 +141,18 @@ public:
     std::unique_ptr<Statement> body;
 };
 
+// Program (sequence of function declarations)
+class Program : public Statement
+{
+public:
+    Program(std::vector<std::unique_ptr<FunctionDeclaration>> functions)
+        : functions(std::move(functions)) {}
+
+    NodeType getType() const override { return NodeType::Program; }
+
+    std::vector<std::unique_ptr<FunctionDeclaration>> functions;
+};
+
 // Variable declaration
 class VariableDeclaration : public Statement
 {
@@ -110,6 +166,32 @@ public:
     std::unique_ptr<Expression> initializer;
 };
 
+// Fixed-size local array declaration (e.g., int a[16];)
+class ArrayDeclaration : public Statement
+{
+public:
+    ArrayDeclaration(std::string name, size_t size)
+        : name(std::move(name)), size(size) {}
+
+    NodeType getType() const override { return NodeType::ArrayDecl; }
+
+    std::string name;
+    size_t size;
+};
+
+// Array element assignment (e.g., a[i] = x;)
+class AssignmentStatement : public Statement
+{
+public:
+    AssignmentStatement(std::unique_ptr<IndexExpression> target, std::unique_ptr<Expression> value)
+        : target(std::move(target)), value(std::move(value)) {}
+
+    NodeType getType() const override { return NodeType::AssignStmt; }
+
+    std::unique_ptr<IndexExpression> target;
+    std::unique_ptr<Expression> value;
+};
+
 // Return statement
 class ReturnStatement : public Statement
 {
@@ -122,6 +204,14 @@ public:
     std::unique_ptr<Expression> value;
 };
 
+// Static prediction for an if condition, filled in by branch layout
+enum class BranchHint
+{
+    None,
+    Likely,  // condition usually true; then branch is the fall-through path
+    Unlikely // condition usually false; then branch is cold
+};
+
 // If statement
 class IfStatement : public Statement
 {
@@ -138,6 +228,7 @@ public:
     std::unique_ptr<Expression> condition;
     std::unique_ptr<Statement> thenBranch;
     std::unique_ptr<Statement> elseBranch;
+    BranchHint hint = BranchHint::None;
 };
 
 // Block statement (sequence of statements)
@@ -158,17 +249,51 @@ class Parser
 public:
     Parser(std::vector<Token> tokens) : tokens(std::move(tokens)), current(0) {}
 
+    // Hands the token buffer back once parsing is done, so it can be reused
+    std::vector<Token> releaseTokens() { return std::move(tokens); }
+
+    std::unique_ptr<Statement> parseProgram()
+    {
+        std::vector<std::unique_ptr<FunctionDeclaration>> functions;
+        while (!isAtEnd())
+        {
+            functions.push_back(parseFunctionDeclaration());
+        }
+        return std::make_unique<Program>(std::move(functions));
+    }
+
     std::unique_ptr<Statement> parseFunction()
+    {
+        return parseFunctionDeclaration();
+    }
+
+private:
+    std::vector<Token> tokens;
+    size_t current;
+    std::string currentFunction;
+
+    std::unique_ptr<FunctionDeclaration> parseFunctionDeclaration()
     {
         try
         {
             consume(TokenType::INT, "Expected 'int' before function declaration");
             std::string name = consume(TokenType::IDENTIFIER, "Expected function name").value;
             consume(TokenType::LPAREN, "Expected '(' after function name");
+
+            std::vector<std::string> params;
+            if (!check(TokenType::RPAREN))
+            {
+                do
+                {
+                    consume(TokenType::INT, "Expected 'int' before parameter name");
+                    params.push_back(consume(TokenType::IDENTIFIER, "Expected parameter name").value);
+                } while (match(TokenType::COMMA));
+            }
             consume(TokenType::RPAREN, "Expected ')' after parameters");
 
+            currentFunction = name;
             auto body = parseBlock();
-            return std::make_unique<FunctionDeclaration>(name, std::vector<std::string>(), std::move(body));
+            return std::make_unique<FunctionDeclaration>(name, std::move(params), std::move(body));
         }
         catch (const std::exception &e)
         {
@@ -176,10 +301,6 @@ public:
         }
     }
 
-private:
-    std::vector<Token> tokens;
-    size_t current;
-
     Token peek() const
     {
         if (current >= tokens.size())
@@ -211,13 +332,18 @@ private:
         return peek().type == TokenType::EOF_TOKEN;
     }
 
+    // Every parse error names the token it is about, so editors can place it
+    [[noreturn]] void errorAt(const Token &token, const std::string &message) const
+    {
+        throw std::runtime_error(message + " at line " + std::to_string(token.line) + ", column " +
+                                 std::to_string(token.column));
+    }
+
     Token consume(TokenType type, const std::string &message)
     {
         if (check(type))
             return advance();
-        throw std::runtime_error(message + " at line " +
-                                 std::to_string(peek().line) + ", column " +
-                                 std::to_string(peek().column));
+        errorAt(peek(), message);
     }
 
     bool match(TokenType type)
@@ -261,6 +387,13 @@ private:
             {
                 auto expr = parseExpression();
                 consume(TokenType::SEMICOLON, "Expected ';' after return statement");
+
+                // A call that is the whole return value is in tail position
+                if (expr->getType() == NodeType::CallExpr)
+                {
+                    auto *call = static_cast<CallExpression *>(expr.get());
+                    call->tailCall = call->callee == currentFunction ? TailCall::Self : TailCall::Sibling;
+                }
                 return std::make_unique<ReturnStatement>(std::move(expr));
             }
 
@@ -286,19 +419,49 @@ private:
             if (match(TokenType::INT))
             {
                 std::string name = consume(TokenType::IDENTIFIER, "Expected variable name").value;
+                if (match(TokenType::LBRACKET))
+                {
+                    Token size = consume(TokenType::NUMBER, "Expected array size");
+                    double count = std::strtod(size.value.c_str(), nullptr);
+                    if (size.value.find('.') != std::string::npos || count < 1)
+                    {
+                        errorAt(size, "Array size must be a positive integer");
+                    }
+                    if (count > UINT32_MAX)
+                    {
+                        errorAt(size, "Array size is too large");
+                    }
+                    consume(TokenType::RBRACKET, "Expected ']' after array size");
+                    consume(TokenType::SEMICOLON, "Expected ';' after array declaration");
+                    return std::make_unique<ArrayDeclaration>(name, static_cast<size_t>(count));
+                }
                 consume(TokenType::ASSIGN, "Expected '=' after variable name");
                 auto initializer = parseExpression();
                 consume(TokenType::SEMICOLON, "Expected ';' after variable declaration");
                 return std::make_unique<VariableDeclaration>(name, std::move(initializer));
             }
 
+            if (match(TokenType::IDENTIFIER))
+            {
+                std::string name = previous().value;
+                consume(TokenType::LBRACKET, "Expected '[' after array name in assignment");
+                auto index = parseExpression();
+                consume(TokenType::RBRACKET, "Expected ']' after array index");
+                consume(TokenType::ASSIGN, "Expected '=' after array element");
+                auto value = parseExpression();
+                consume(TokenType::SEMICOLON, "Expected ';' after assignment");
+                return std::make_unique<AssignmentStatement>(
+                    std::make_unique<IndexExpression>(name, std::move(index)),
+                    std::move(value));
+            }
+
             if (match(TokenType::LBRACE))
             {
                 current--; // Unconsume the LBRACE
                 return parseBlock();
             }
 
-            throw std::runtime_error("Unexpected token: " + tokenTypeToString(peek().type));
+            errorAt(peek(), "Unexpected token: " + tokenTypeToString(peek().type));
         }
         catch (const std::exception &e)
         {
@@ -366,14 +529,34 @@ private:
     {
         if (match(TokenType::NUMBER))
         {
+            // strtod, unlike stod, saturates a literal too large for a double instead of throwing
             return std::make_unique<NumberExpression>(
-                std::stod(previous().value));
+                std::strtod(previous().value.c_str(), nullptr));
         }
 
         if (match(TokenType::IDENTIFIER))
         {
-            return std::make_unique<IdentifierExpression>(
-                previous().value);
+            std::string name = previous().value;
+            if (match(TokenType::LPAREN))
+            {
+                std::vector<std::unique_ptr<Expression>> arguments;
+                if (!check(TokenType::RPAREN))
+                {
+                    do
+                    {
+                        arguments.push_back(parseExpression());
+                    } while (match(TokenType::COMMA));
+                }
+                consume(TokenType::RPAREN, "Expected ')' after arguments");
+                return std::make_unique<CallExpression>(std::move(name), std::move(arguments));
+            }
+            if (match(TokenType::LBRACKET))
+            {
+                auto index = parseExpression();
+                consume(TokenType::RBRACKET, "Expected ']' after array index");
+                return std::make_unique<IndexExpression>(std::move(name), std::move(index));
+            }
+            return std::make_unique<IdentifierExpression>(std::move(name));
         }
 
         if (match(TokenType::LPAREN))
@@ -383,6 +566,6 @@ private:
             return expr;
         }
 
-        throw std::runtime_error("Expected expression, got " + tokenTypeToString(peek().type));
+        errorAt(peek(), "Expected expression, got " + tokenTypeToString(peek().type));
     }
 };
@@ -0,0 +1,240 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+#include "parser.hpp"
+#include "trace_events.hpp"
+
+// Caches analysis results for a single function. An analysis is a type with
+// a nested `Result` type and a static `Result run(const FunctionDeclaration &)`.
+class AnalysisManager
+{
+private:
+    const FunctionDeclaration &function;
+    std::unordered_map<std::type_index, std::shared_ptr<void>> results;
+
+public:
+    explicit AnalysisManager(const FunctionDeclaration &function) : function(function) {}
+
+    template <typename Analysis>
+    const typename Analysis::Result &get()
+    {
+        auto it = results.find(typeid(Analysis));
+        if (it == results.end())
+        {
+            auto result = std::make_shared<typename Analysis::Result>(Analysis::run(function));
+            it = results.emplace(typeid(Analysis), std::move(result)).first;
+        }
+        return *static_cast<const typename Analysis::Result *>(it->second.get());
+    }
+
+    template <typename Analysis>
+    void invalidate()
+    {
+        results.erase(typeid(Analysis));
+    }
+
+    void invalidateAll() { results.clear(); }
+};
+
+// Number of AST nodes in a function, used to report how passes change its size
+struct NodeCountAnalysis
+{
+    using Result = size_t;
+
+    static size_t countExpression(const Expression *expr)
+    {
+        switch (expr->getType())
+        {
+        case NodeType::BinaryExpr:
+        {
+            auto *binary = static_cast<const BinaryExpression *>(expr);
+            return 1 + countExpression(binary->left.get()) + countExpression(binary->right.get());
+        }
+        case NodeType::CallExpr:
+        {
+            size_t count = 1;
+            for (const auto &arg : static_cast<const CallExpression *>(expr)->arguments)
+                count += countExpression(arg.get());
+            return count;
+        }
+        case NodeType::IndexExpr:
+            return 1 + countExpression(static_cast<const IndexExpression *>(expr)->index.get());
+        default:
+            return 1;
+        }
+    }
+
+    static size_t countStatement(const Statement *stmt)
+    {
+        switch (stmt->getType())
+        {
+        case NodeType::VarDecl:
+            return 1 + countExpression(static_cast<const VariableDeclaration *>(stmt)->initializer.get());
+        case NodeType::AssignStmt:
+        {
+            auto *assign = static_cast<const AssignmentStatement *>(stmt);
+            return 1 + countExpression(assign->target.get()) + countExpression(assign->value.get());
+        }
+        case NodeType::ReturnStmt:
+            return 1 + countExpression(static_cast<const ReturnStatement *>(stmt)->value.get());
+        case NodeType::IfStmt:
+        {
+            auto *ifStmt = static_cast<const IfStatement *>(stmt);
+            size_t count = 1 + countExpression(ifStmt->condition.get()) + countStatement(ifStmt->thenBranch.get());
+            if (ifStmt->elseBranch)
+                count += countStatement(ifStmt->elseBranch.get());
+            return count;
+        }
+        case NodeType::BlockStmt:
+        {
+            size_t count = 1;
+            for (const auto &s : static_cast<const BlockStatement *>(stmt)->statements)
+                count += countStatement(s.get());
+            return count;
+        }
+        default:
+            return 1;
+        }
+    }
+
+    static Result run(const FunctionDeclaration &func)
+    {
+        return 1 + countStatement(func.body.get());
+    }
+};
+
+// A transformation over one function. Returns true if the function changed,
+// in which case the pass manager drops every cached analysis.
+class FunctionPass
+{
+public:
+    virtual ~FunctionPass() = default;
+    virtual const char *name() const = 0;
+    virtual bool run(FunctionDeclaration &func, AnalysisManager &analyses) = 0;
+
+    // Expensive passes are skipped once a function exhausts its compile budget
+    virtual bool isExpensive() const { return false; }
+};
+
+// Per-function compile budget; a zero limit means unlimited. Work is measured
+// as the number of AST nodes fed to passes.
+struct PassBudget
+{
+    double seconds = 0;
+    size_t work = 0;
+
+    bool limited() const { return seconds > 0 || work > 0; }
+};
+
+// Wall time and AST size change of one pass, summed over all functions
+struct PassStatistics
+{
+    std::string name;
+    double seconds = 0;
+    size_t nodesBefore = 0;
+    size_t nodesAfter = 0;
+    size_t changedFunctions = 0;
+    std::vector<std::string> skippedFunctions; // skipped for being over budget
+};
+
+// Adds one run's statistics to a running total of the same pipeline
+inline void mergeStatistics(std::vector<PassStatistics> &total, const std::vector<PassStatistics> &run)
+{
+    if (total.empty())
+    {
+        total = run;
+        return;
+    }
+    for (size_t i = 0; i < total.size() && i < run.size(); i++)
+    {
+        total[i].seconds += run[i].seconds;
+        total[i].nodesBefore += run[i].nodesBefore;
+        total[i].nodesAfter += run[i].nodesAfter;
+        total[i].changedFunctions += run[i].changedFunctions;
+        total[i].skippedFunctions.insert(total[i].skippedFunctions.end(),
+                                         run[i].skippedFunctions.begin(), run[i].skippedFunctions.end());
+    }
+}
+
+class PassManager
+{
+private:
+    std::vector<std::unique_ptr<FunctionPass>> passes;
+    std::vector<PassStatistics> statistics;
+    PassBudget budget;
+    TraceRecorder *trace = nullptr;
+
+public:
+    void setBudget(PassBudget newBudget) { budget = newBudget; }
+
+    // Records one span per pass run; null disables tracing
+    void setTrace(TraceRecorder *recorder) { trace = recorder; }
+
+    void addPass(std::unique_ptr<FunctionPass> pass)
+    {
+        PassStatistics stats;
+        stats.name = pass->name();
+        statistics.push_back(stats);
+        passes.push_back(std::move(pass));
+    }
+
+    bool empty() const { return passes.empty(); }
+
+    void run(FunctionDeclaration &func)
+    {
+        AnalysisManager analyses(func);
+        double spentSeconds = 0;
+        size_t spentWork = 0;
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            PassStatistics &stats = statistics[i];
+            size_t nodes = analyses.get<NodeCountAnalysis>();
+
+            bool overBudget = (budget.seconds > 0 && spentSeconds >= budget.seconds) ||
+                              (budget.work > 0 && spentWork >= budget.work);
+            if (overBudget && passes[i]->isExpensive())
+            {
+                stats.skippedFunctions.push_back(func.name);
+                continue;
+            }
+            stats.nodesBefore += nodes;
+
+            auto start = std::chrono::steady_clock::now();
+            bool changed = passes[i]->run(func, analyses);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (trace)
+                trace->record(stats.name, "pass", start, {{"function", func.name}});
+            stats.seconds += seconds;
+            spentSeconds += seconds;
+            spentWork += nodes;
+
+            if (changed)
+            {
+                analyses.invalidateAll();
+                stats.changedFunctions++;
+            }
+            stats.nodesAfter += analyses.get<NodeCountAnalysis>();
+        }
+    }
+
+    void run(Statement *root)
+    {
+        if (root->getType() == NodeType::Program)
+        {
+            for (auto &func : static_cast<Program *>(root)->functions)
+            {
+                run(*func);
+            }
+        }
+        else if (root->getType() == NodeType::FunctionDecl)
+        {
+            run(*static_cast<FunctionDeclaration *>(root));
+        }
+    }
+
+    const std::vector<PassStatistics> &getStatistics() const { return statistics; }
+};
@@ -0,0 +1,741 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "check_elimination.hpp"
+#include "pass_manager.hpp"
+#include "range_analysis.hpp"
+
+// Name -> number of references (reads and element writes) in a function.
+// Counted by name, so a shadowed variable shares its count with the outer one.
+struct VariableUseAnalysis
+{
+    using Result = std::unordered_map<std::string, size_t>;
+
+    static void countExpression(const Expression *expr, Result &uses)
+    {
+        switch (expr->getType())
+        {
+        case NodeType::IdentifierExpr:
+            uses[static_cast<const IdentifierExpression *>(expr)->name]++;
+            break;
+        case NodeType::IndexExpr:
+        {
+            auto *index = static_cast<const IndexExpression *>(expr);
+            uses[index->array]++;
+            countExpression(index->index.get(), uses);
+            break;
+        }
+        case NodeType::BinaryExpr:
+        {
+            auto *binary = static_cast<const BinaryExpression *>(expr);
+            countExpression(binary->left.get(), uses);
+            countExpression(binary->right.get(), uses);
+            break;
+        }
+        case NodeType::CallExpr:
+            for (const auto &arg : static_cast<const CallExpression *>(expr)->arguments)
+                countExpression(arg.get(), uses);
+            break;
+        default:
+            break;
+        }
+    }
+
+    static void countStatement(const Statement *stmt, Result &uses)
+    {
+        switch (stmt->getType())
+        {
+        case NodeType::VarDecl:
+            countExpression(static_cast<const VariableDeclaration *>(stmt)->initializer.get(), uses);
+            break;
+        case NodeType::AssignStmt:
+        {
+            auto *assign = static_cast<const AssignmentStatement *>(stmt);
+            countExpression(assign->target.get(), uses);
+            countExpression(assign->value.get(), uses);
+            break;
+        }
+        case NodeType::ReturnStmt:
+            countExpression(static_cast<const ReturnStatement *>(stmt)->value.get(), uses);
+            break;
+        case NodeType::IfStmt:
+        {
+            auto *ifStmt = static_cast<const IfStatement *>(stmt);
+            countExpression(ifStmt->condition.get(), uses);
+            countStatement(ifStmt->thenBranch.get(), uses);
+            if (ifStmt->elseBranch)
+                countStatement(ifStmt->elseBranch.get(), uses);
+            break;
+        }
+        case NodeType::BlockStmt:
+            for (const auto &s : static_cast<const BlockStatement *>(stmt)->statements)
+                countStatement(s.get(), uses);
+            break;
+        default:
+            break;
+        }
+    }
+
+    static Result run(const FunctionDeclaration &func)
+    {
+        Result uses;
+        countStatement(func.body.get(), uses);
+        return uses;
+    }
+};
+
+// Replaces every expression whose value range analysis proves constant
+// (including reads of variables with constant initializers) by a literal
+class ConstantFoldingPass : public FunctionPass
+{
+private:
+    RangeAnalysis ranges;
+    bool changed = false;
+
+    void foldExpression(std::unique_ptr<Expression> &expr)
+    {
+        if (expr->getType() == NodeType::NumberExpr)
+            return;
+
+        ValueRange range = ranges.rangeOf(expr.get());
+        if (range.isConstant())
+        {
+            expr = std::make_unique<NumberExpression>(static_cast<double>(range.min));
+            changed = true;
+            return;
+        }
+
+        switch (expr->getType())
+        {
+        case NodeType::BinaryExpr:
+        {
+            auto *binary = static_cast<BinaryExpression *>(expr.get());
+            foldExpression(binary->left);
+            foldExpression(binary->right);
+            break;
+        }
+        case NodeType::CallExpr:
+            for (auto &arg : static_cast<CallExpression *>(expr.get())->arguments)
+                foldExpression(arg);
+            break;
+        case NodeType::IndexExpr:
+            foldExpression(static_cast<IndexExpression *>(expr.get())->index);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void foldStatement(Statement *stmt)
+    {
+        switch (stmt->getType())
+        {
+        case NodeType::VarDecl:
+        {
+            auto *varDecl = static_cast<VariableDeclaration *>(stmt);
+            foldExpression(varDecl->initializer);
+            ranges.declare(varDecl->name, ranges.rangeOf(varDecl->initializer.get()));
+            break;
+        }
+        case NodeType::ArrayDecl:
+        {
+            auto *arrayDecl = static_cast<ArrayDeclaration *>(stmt);
+            ranges.declareArray(arrayDecl->name, arrayDecl->size);
+            break;
+        }
+        case NodeType::AssignStmt:
+        {
+            auto *assign = static_cast<AssignmentStatement *>(stmt);
+            foldExpression(assign->target->index);
+            foldExpression(assign->value);
+            break;
+        }
+        case NodeType::ReturnStmt:
+            foldExpression(static_cast<ReturnStatement *>(stmt)->value);
+            break;
+        case NodeType::IfStmt:
+        {
+            auto *ifStmt = static_cast<IfStatement *>(stmt);
+            foldExpression(ifStmt->condition);
+            ranges.enterScope();
+            foldStatement(ifStmt->thenBranch.get());
+            if (ifStmt->elseBranch)
+                foldStatement(ifStmt->elseBranch.get());
+            ranges.exitScope();
+            break;
+        }
+        case NodeType::BlockStmt:
+            ranges.enterScope();
+            for (auto &s : static_cast<BlockStatement *>(stmt)->statements)
+                foldStatement(s.get());
+            ranges.exitScope();
+            break;
+        default:
+            break;
+        }
+    }
+
+public:
+    const char *name() const override { return "constant-folding"; }
+
+    bool run(FunctionDeclaration &func, AnalysisManager &) override
+    {
+        changed = false;
+        ranges.enterScope();
+        for (const auto &param : func.parameters)
+            ranges.declare(param, ValueRange::unknown());
+        foldStatement(func.body.get());
+        ranges.exitScope();
+        return changed;
+    }
+};
+
+// Removes statements after a return, branches of ifs with constant
+// conditions, and blocks left empty by either
+class DeadCodeEliminationPass : public FunctionPass
+{
+private:
+    bool changed = false;
+
+public:
+    static bool alwaysReturns(const Statement *stmt)
+    {
+        switch (stmt->getType())
+        {
+        case NodeType::ReturnStmt:
+            return true;
+        case NodeType::IfStmt:
+        {
+            auto *ifStmt = static_cast<const IfStatement *>(stmt);
+            return ifStmt->elseBranch && alwaysReturns(ifStmt->thenBranch.get()) &&
+                   alwaysReturns(ifStmt->elseBranch.get());
+        }
+        case NodeType::BlockStmt:
+            for (const auto &s : static_cast<const BlockStatement *>(stmt)->statements)
+                if (alwaysReturns(s.get()))
+                    return true;
+            return false;
+        default:
+            return false;
+        }
+    }
+
+private:
+    // Keeps a branch in its own scope when it replaces the if statement
+    static std::unique_ptr<Statement> asBlock(std::unique_ptr<Statement> stmt)
+    {
+        std::vector<std::unique_ptr<Statement>> statements;
+        if (stmt)
+        {
+            if (stmt->getType() == NodeType::BlockStmt)
+                return stmt;
+            statements.push_back(std::move(stmt));
+        }
+        return std::make_unique<BlockStatement>(std::move(statements));
+    }
+
+    void simplifyStatement(std::unique_ptr<Statement> &stmt)
+    {
+        if (stmt->getType() == NodeType::IfStmt)
+        {
+            auto *ifStmt = static_cast<IfStatement *>(stmt.get());
+            if (ifStmt->condition->getType() == NodeType::NumberExpr)
+            {
+                bool taken = static_cast<NumberExpression *>(ifStmt->condition.get())->value != 0;
+                stmt = asBlock(taken ? std::move(ifStmt->thenBranch) : std::move(ifStmt->elseBranch));
+                changed = true;
+            }
+            else
+            {
+                simplifyStatement(ifStmt->thenBranch);
+                if (ifStmt->elseBranch)
+                    simplifyStatement(ifStmt->elseBranch);
+                return;
+            }
+        }
+
+        if (stmt->getType() == NodeType::BlockStmt)
+        {
+            auto &statements = static_cast<BlockStatement *>(stmt.get())->statements;
+            std::vector<std::unique_ptr<Statement>> kept;
+            for (auto &s : statements)
+            {
+                simplifyStatement(s);
+                bool empty = s->getType() == NodeType::BlockStmt &&
+                             static_cast<BlockStatement *>(s.get())->statements.empty();
+                if (empty)
+                {
+                    changed = true;
+                    continue;
+                }
+                kept.push_back(std::move(s));
+                if (alwaysReturns(kept.back().get()))
+                    break;
+            }
+            if (kept.size() != statements.size())
+                changed = true;
+            statements = std::move(kept);
+        }
+    }
+
+public:
+    const char *name() const override { return "dead-code-elimination"; }
+
+    bool run(FunctionDeclaration &func, AnalysisManager &) override
+    {
+        changed = false;
+        simplifyStatement(func.body);
+        return changed;
+    }
+};
+
+// Removes unreferenced variables whose initializers cannot trap or call,
+// and unreferenced arrays
+class DeadVariableEliminationPass : public FunctionPass
+{
+private:
+    bool changed = false;
+
+    static bool isPure(const Expression *expr)
+    {
+        switch (expr->getType())
+        {
+        case NodeType::NumberExpr:
+        case NodeType::IdentifierExpr:
+            return true;
+        case NodeType::BinaryExpr:
+        {
+            auto *binary = static_cast<const BinaryExpression *>(expr);
+            return binary->op != TokenType::DIVIDE && isPure(binary->left.get()) &&
+                   isPure(binary->right.get());
+        }
+        default:
+            return false;
+        }
+    }
+
+    bool isDead(const Statement *stmt, const VariableUseAnalysis::Result &uses) const
+    {
+        if (stmt->getType() == NodeType::VarDecl)
+        {
+            auto *varDecl = static_cast<const VariableDeclaration *>(stmt);
+            return uses.count(varDecl->name) == 0 && isPure(varDecl->initializer.get());
+        }
+        if (stmt->getType() == NodeType::ArrayDecl)
+        {
+            return uses.count(static_cast<const ArrayDeclaration *>(stmt)->name) == 0;
+        }
+        return false;
+    }
+
+    void sweep(Statement *stmt, const VariableUseAnalysis::Result &uses)
+    {
+        if (stmt->getType() == NodeType::IfStmt)
+        {
+            auto *ifStmt = static_cast<IfStatement *>(stmt);
+            sweep(ifStmt->thenBranch.get(), uses);
+            if (ifStmt->elseBranch)
+                sweep(ifStmt->elseBranch.get(), uses);
+        }
+        else if (stmt->getType() == NodeType::BlockStmt)
+        {
+            auto &statements = static_cast<BlockStatement *>(stmt)->statements;
+            std::vector<std::unique_ptr<Statement>> kept;
+            for (auto &s : statements)
+            {
+                if (isDead(s.get(), uses))
+                {
+                    changed = true;
+                    continue;
+                }
+                sweep(s.get(), uses);
+                kept.push_back(std::move(s));
+            }
+            statements = std::move(kept);
+        }
+    }
+
+public:
+    const char *name() const override { return "dead-variable-elimination"; }
+    bool isExpensive() const override { return true; }
+
+    bool run(FunctionDeclaration &func, AnalysisManager &analyses) override
+    {
+        changed = false;
+        sweep(func.body.get(), analyses.get<VariableUseAnalysis>());
+        return changed;
+    }
+};
+
+// Predicts each if condition with static heuristics and orders the branches
+// so the hot one comes first and falls through. When an if has no else, a
+// cold then branch is only marked Unlikely so lowering can move it out of line.
+class BranchLayoutPass : public FunctionPass
+{
+private:
+    bool changed = false;
+
+    bool containsSelfTailCall(const Statement *stmt) const
+    {
+        switch (stmt->getType())
+        {
+        case NodeType::ReturnStmt:
+        {
+            auto *value = static_cast<const ReturnStatement *>(stmt)->value.get();
+            return value->getType() == NodeType::CallExpr &&
+                   static_cast<const CallExpression *>(value)->tailCall == TailCall::Self;
+        }
+        case NodeType::IfStmt:
+        {
+            auto *ifStmt = static_cast<const IfStatement *>(stmt);
+            return containsSelfTailCall(ifStmt->thenBranch.get()) ||
+                   (ifStmt->elseBranch && containsSelfTailCall(ifStmt->elseBranch.get()));
+        }
+        case NodeType::BlockStmt:
+            for (const auto &s : static_cast<const BlockStatement *>(stmt)->statements)
+                if (containsSelfTailCall(s.get()))
+                    return true;
+            return false;
+        default:
+            return false;
+        }
+    }
+
+    static bool isZero(const Expression *expr)
+    {
+        return expr->getType() == NodeType::NumberExpr &&
+               static_cast<const NumberExpression *>(expr)->value == 0;
+    }
+
+    // Whether the condition is usually true, after Ball and Larus
+    BranchHint predict(const IfStatement *ifStmt) const
+    {
+        // A self tail call is a loop back edge once lowered, and loops iterate
+        bool thenLoops = containsSelfTailCall(ifStmt->thenBranch.get());
+        bool elseLoops = ifStmt->elseBranch && containsSelfTailCall(ifStmt->elseBranch.get());
+        if (thenLoops != elseLoops)
+            return thenLoops ? BranchHint::Likely : BranchHint::Unlikely;
+
+        // Early returns are usually error or base cases
+        bool thenReturns = DeadCodeEliminationPass::alwaysReturns(ifStmt->thenBranch.get());
+        bool elseReturns = ifStmt->elseBranch && DeadCodeEliminationPass::alwaysReturns(ifStmt->elseBranch.get());
+        if (thenReturns != elseReturns)
+            return thenReturns ? BranchHint::Unlikely : BranchHint::Likely;
+
+        // Equality rarely holds, and values are rarely negative
+        if (ifStmt->condition->getType() == NodeType::BinaryExpr)
+        {
+            auto *binary = static_cast<const BinaryExpression *>(ifStmt->condition.get());
+            switch (binary->op)
+            {
+            case TokenType::EQUAL:
+                return BranchHint::Unlikely;
+            case TokenType::NOT_EQUAL:
+                return BranchHint::Likely;
+            case TokenType::LESS:
+            case TokenType::LESS_EQUAL:
+                if (isZero(binary->right.get()))
+                    return BranchHint::Unlikely;
+                break;
+            case TokenType::GREATER:
+            case TokenType::GREATER_EQUAL:
+                if (isZero(binary->right.get()))
+                    return BranchHint::Likely;
+                break;
+            default:
+                break;
+            }
+        }
+        return BranchHint::None;
+    }
+
+    static TokenType invert(TokenType op)
+    {
+        switch (op)
+        {
+        case TokenType::GREATER:
+            return TokenType::LESS_EQUAL;
+        case TokenType::GREATER_EQUAL:
+            return TokenType::LESS;
+        case TokenType::LESS:
+            return TokenType::GREATER_EQUAL;
+        case TokenType::LESS_EQUAL:
+            return TokenType::GREATER;
+        case TokenType::EQUAL:
+            return TokenType::NOT_EQUAL;
+        default:
+            return TokenType::EQUAL;
+        }
+    }
+
+    static void negate(std::unique_ptr<Expression> &condition)
+    {
+        if (condition->getType() == NodeType::BinaryExpr)
+        {
+            auto *binary = static_cast<BinaryExpression *>(condition.get());
+            switch (binary->op)
+            {
+            case TokenType::GREATER:
+            case TokenType::GREATER_EQUAL:
+            case TokenType::LESS:
+            case TokenType::LESS_EQUAL:
+            case TokenType::EQUAL:
+            case TokenType::NOT_EQUAL:
+                binary->op = invert(binary->op);
+                return;
+            default:
+                break;
+            }
+        }
+        condition = std::make_unique<BinaryExpression>(std::move(condition), TokenType::EQUAL,
+                                                       std::make_unique<NumberExpression>(0));
+    }
+
+    void layout(Statement *stmt)
+    {
+        if (stmt->getType() == NodeType::IfStmt)
+        {
+            auto *ifStmt = static_cast<IfStatement *>(stmt);
+            layout(ifStmt->thenBranch.get());
+            if (ifStmt->elseBranch)
+                layout(ifStmt->elseBranch.get());
+
+            BranchHint hint = predict(ifStmt);
+            if (hint == BranchHint::Unlikely && ifStmt->elseBranch)
+            {
+                negate(ifStmt->condition);
+                std::swap(ifStmt->thenBranch, ifStmt->elseBranch);
+                hint = BranchHint::Likely;
+                changed = true;
+            }
+            if (hint != ifStmt->hint)
+            {
+                ifStmt->hint = hint;
+                changed = true;
+            }
+        }
+        else if (stmt->getType() == NodeType::BlockStmt)
+        {
+            for (auto &s : static_cast<BlockStatement *>(stmt)->statements)
+                layout(s.get());
+        }
+    }
+
+public:
+    const char *name() const override { return "branch-layout"; }
+
+    bool run(FunctionDeclaration &func, AnalysisManager &) override
+    {
+        changed = false;
+        layout(func.body.get());
+        return changed;
+    }
+};
+
+// Rebalances chains of an associative integer operator, e.g. ((a + b) + c) + d
+// becomes (a + b) + (c + d), so the critical path of the chain is logarithmic
+// in its length rather than linear. Operand order is kept, so calls and traps
+// still happen left to right.
+class ReassociationPass : public FunctionPass
+{
+private:
+    bool changed = false;
+
+    static bool isAssociative(TokenType op)
+    {
+        return op == TokenType::PLUS || op == TokenType::MULTIPLY;
+    }
+
+    static void collectOperands(std::unique_ptr<Expression> &expr, TokenType op,
+                                std::vector<std::unique_ptr<Expression>> &operands)
+    {
+        if (expr->getType() == NodeType::BinaryExpr &&
+            static_cast<BinaryExpression *>(expr.get())->op == op)
+        {
+            auto *binary = static_cast<BinaryExpression *>(expr.get());
+            collectOperands(binary->left, op, operands);
+            collectOperands(binary->right, op, operands);
+            return;
+        }
+        operands.push_back(std::move(expr));
+    }
+
+    static std::unique_ptr<Expression> buildBalanced(std::vector<std::unique_ptr<Expression>> &operands,
+                                                     size_t begin, size_t end, TokenType op)
+    {
+        if (end - begin == 1)
+            return std::move(operands[begin]);
+        size_t middle = begin + (end - begin + 1) / 2;
+        auto left = buildBalanced(operands, begin, middle, op);
+        auto right = buildBalanced(operands, middle, end, op);
+        return std::make_unique<BinaryExpression>(std::move(left), op, std::move(right));
+    }
+
+    static bool isChainNode(const Expression *expr, TokenType op)
+    {
+        return expr->getType() == NodeType::BinaryExpr && static_cast<const BinaryExpression *>(expr)->op == op;
+    }
+
+    // Depth of the chain of `op` nodes rooted at `expr`; `operands` receives
+    // the number of leaves the chain combines
+    static size_t chainDepth(const Expression *expr, TokenType op, size_t &operands)
+    {
+        if (!isChainNode(expr, op))
+        {
+            operands++;
+            return 0;
+        }
+        auto *binary = static_cast<const BinaryExpression *>(expr);
+        size_t left = chainDepth(binary->left.get(), op, operands);
+        size_t right = chainDepth(binary->right.get(), op, operands);
+        return 1 + std::max(left, right);
+    }
+
+    // Depth of the tree buildBalanced makes from `operands` leaves
+    static size_t balancedDepth(size_t operands)
+    {
+        size_t depth = 0;
+        while ((size_t(1) << depth) < operands)
+            depth++;
+        return depth;
+    }
+
+    // Reassociates inside the operands of a chain that keeps its shape
+    void reassociateOperands(std::unique_ptr<Expression> &expr, TokenType op)
+    {
+        if (!isChainNode(expr.get(), op))
+        {
+            reassociate(expr);
+            return;
+        }
+        auto *binary = static_cast<BinaryExpression *>(expr.get());
+        reassociateOperands(binary->left, op);
+        reassociateOperands(binary->right, op);
+    }
+
+    void reassociate(std::unique_ptr<Expression> &expr)
+    {
+        switch (expr->getType())
+        {
+        case NodeType::BinaryExpr:
+        {
+            auto *binary = static_cast<BinaryExpression *>(expr.get());
+            if (!isAssociative(binary->op))
+            {
+                reassociate(binary->left);
+                reassociate(binary->right);
+                return;
+            }
+
+            // Only rebuild a chain the balanced shape actually makes shallower
+            TokenType op = binary->op;
+            size_t count = 0;
+            size_t before = chainDepth(expr.get(), op, count);
+            if (balancedDepth(count) >= before)
+            {
+                reassociateOperands(expr, op);
+                return;
+            }
+            std::vector<std::unique_ptr<Expression>> operands;
+            collectOperands(expr, op, operands);
+            for (auto &operand : operands)
+                reassociate(operand);
+            expr = buildBalanced(operands, 0, operands.size(), op);
+            changed = true;
+            break;
+        }
+        case NodeType::CallExpr:
+            for (auto &arg : static_cast<CallExpression *>(expr.get())->arguments)
+                reassociate(arg);
+            break;
+        case NodeType::IndexExpr:
+            reassociate(static_cast<IndexExpression *>(expr.get())->index);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void visit(Statement *stmt)
+    {
+        switch (stmt->getType())
+        {
+        case NodeType::VarDecl:
+            reassociate(static_cast<VariableDeclaration *>(stmt)->initializer);
+            break;
+        case NodeType::AssignStmt:
+        {
+            auto *assign = static_cast<AssignmentStatement *>(stmt);
+            reassociate(assign->target->index);
+            reassociate(assign->value);
+            break;
+        }
+        case NodeType::ReturnStmt:
+            reassociate(static_cast<ReturnStatement *>(stmt)->value);
+            break;
+        case NodeType::IfStmt:
+        {
+            auto *ifStmt = static_cast<IfStatement *>(stmt);
+            reassociate(ifStmt->condition);
+            visit(ifStmt->thenBranch.get());
+            if (ifStmt->elseBranch)
+                visit(ifStmt->elseBranch.get());
+            break;
+        }
+        case NodeType::BlockStmt:
+            for (auto &s : static_cast<BlockStatement *>(stmt)->statements)
+                visit(s.get());
+            break;
+        default:
+            break;
+        }
+    }
+
+public:
+    const char *name() const override { return "reassociation"; }
+
+    bool run(FunctionDeclaration &func, AnalysisManager &) override
+    {
+        changed = false;
+        visit(func.body.get());
+        return changed;
+    }
+};
+
+class CheckEliminationPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "check-elimination"; }
+    bool isExpensive() const override { return true; }
+
+    bool run(FunctionDeclaration &func, AnalysisManager &) override
+    {
+        CheckEliminator eliminator;
+        eliminator.run(&func);
+        return eliminator.eliminatedCount() != 0;
+    }
+};
+
+// Standard pipelines for -O0, -O1 and -O2
+inline PassManager createPipeline(int optLevel)
+{
+    PassManager pipeline;
+    if (optLevel >= 1)
+    {
+        pipeline.addPass(std::make_unique<ConstantFoldingPass>());
+        pipeline.addPass(std::make_unique<DeadCodeEliminationPass>());
+    }
+    if (optLevel >= 2)
+    {
+        pipeline.addPass(std::make_unique<DeadVariableEliminationPass>());
+        pipeline.addPass(std::make_unique<BranchLayoutPass>());
+        pipeline.addPass(std::make_unique<ReassociationPass>());
+    }
+    if (optLevel >= 1)
+    {
+        pipeline.addPass(std::make_unique<CheckEliminationPass>());
+    }
+    return pipeline;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counter readings, or differences between two readings
+struct PerfSample
+{
+    static constexpr size_t COUNT = 4;
+    uint64_t values[COUNT] = {};
+    bool valid[COUNT] = {}; // counter opened and actually scheduled
+
+    static const char *name(size_t counter)
+    {
+        static const char *names[COUNT] = {"cycles", "instructions", "branch-misses", "cache-misses"};
+        return names[counter];
+    }
+
+    PerfSample operator-(const PerfSample &earlier) const
+    {
+        PerfSample delta;
+        for (size_t i = 0; i < COUNT; i++)
+        {
+            delta.valid[i] = valid[i] && earlier.valid[i];
+            delta.values[i] = delta.valid[i] ? values[i] - earlier.values[i] : 0;
+        }
+        return delta;
+    }
+
+    PerfSample &operator+=(const PerfSample &other)
+    {
+        for (size_t i = 0; i < COUNT; i++)
+        {
+            valid[i] = valid[i] || other.valid[i];
+            values[i] += other.values[i];
+        }
+        return *this;
+    }
+
+    bool any() const
+    {
+        for (bool counted : valid)
+        {
+            if (counted)
+                return true;
+        }
+        return false;
+    }
+};
+
+// User-space hardware counters for the calling thread, through
+// perf_event_open. Threads the owner starts later are inherited, so a phase
+// that spawns and joins workers counts their work too. Counters that cannot
+// be opened (no PMU in a VM, perf_event_paranoid, not Linux) are left out,
+// and `unavailableReason()` says why none could be.
+class PerfCounters
+{
+private:
+    int fds[PerfSample::COUNT];
+    std::string reason;
+
+public:
+    PerfCounters()
+    {
+        for (int &fd : fds)
+            fd = -1;
+#ifdef __linux__
+        static const uint64_t configs[PerfSample::COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+        for (size_t i = 0; i < PerfSample::COUNT; i++)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.inherit = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds[i] < 0 && reason.empty())
+                reason = std::string("perf_event_open: ") + std::strerror(errno);
+        }
+#else
+        reason = "hardware counters are only supported on Linux";
+#endif
+        if (available())
+            reason.clear();
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+                ::close(fd);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Counters of the calling thread, opened on first use
+    static PerfCounters &forThisThread()
+    {
+        thread_local PerfCounters counters;
+        return counters;
+    }
+
+    bool available() const
+    {
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    const std::string &unavailableReason() const { return reason; }
+
+    // Current totals, scaled up when the kernel multiplexed a counter
+    PerfSample read() const
+    {
+        PerfSample sample;
+#ifdef __linux__
+        for (size_t i = 0; i < PerfSample::COUNT; i++)
+        {
+            uint64_t data[3]; // value, time enabled, time running
+            if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) ||
+                data[2] == 0)
+                continue;
+            sample.valid[i] = true;
+            sample.values[i] = data[2] < data[1]
+                                   ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2])
+                                   : data[0];
+        }
+#endif
+        return sample;
+    }
+};
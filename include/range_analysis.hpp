@@ -0,0 +1,180 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "parser.hpp"
+
+// Closed integer interval [min, max]; `known` is false when nothing can be proven
+struct ValueRange
+{
+    long long min = 0;
+    long long max = 0;
+    bool known = false;
+
+    static ValueRange unknown() { return ValueRange(); }
+
+    static ValueRange of(long long min, long long max)
+    {
+        // Anything outside the int range may wrap, so give up on it
+        if (min < INT_MIN || max > INT_MAX)
+            return unknown();
+        ValueRange range;
+        range.min = min;
+        range.max = max;
+        range.known = true;
+        return range;
+    }
+
+    bool within(long long low, long long high) const
+    {
+        return known && min >= low && max <= high;
+    }
+
+    bool isConstant() const { return known && min == max; }
+
+    bool operator==(const ValueRange &other) const
+    {
+        return known == other.known && min == other.min && max == other.max;
+    }
+};
+
+// Scoped interval analysis over the AST. Scalars are never reassigned after
+// their declaration, so a variable's range is the range of its initializer.
+class RangeAnalysis
+{
+private:
+    struct Symbol
+    {
+        ValueRange range;
+        size_t arraySize = 0; // 0 for scalars
+    };
+
+    std::vector<std::unordered_map<std::string, Symbol>> scopes;
+
+    static bool isComparison(TokenType op)
+    {
+        return op == TokenType::GREATER || op == TokenType::GREATER_EQUAL ||
+               op == TokenType::LESS || op == TokenType::LESS_EQUAL ||
+               op == TokenType::EQUAL || op == TokenType::NOT_EQUAL;
+    }
+
+    // Result of a comparison that is definitely true, definitely false, or either
+    static ValueRange compare(bool alwaysTrue, bool alwaysFalse)
+    {
+        if (alwaysTrue)
+            return ValueRange::of(1, 1);
+        if (alwaysFalse)
+            return ValueRange::of(0, 0);
+        return ValueRange::of(0, 1);
+    }
+
+    const Symbol *lookup(const std::string &name) const
+    {
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it)
+        {
+            auto found = it->find(name);
+            if (found != it->end())
+                return &found->second;
+        }
+        return nullptr;
+    }
+
+public:
+    void enterScope() { scopes.emplace_back(); }
+    void exitScope() { scopes.pop_back(); }
+
+    void declare(const std::string &name, ValueRange range)
+    {
+        scopes.back()[name] = Symbol{range, 0};
+    }
+
+    void declareArray(const std::string &name, size_t size)
+    {
+        scopes.back()[name] = Symbol{ValueRange::unknown(), size};
+    }
+
+    size_t arraySize(const std::string &name) const
+    {
+        const Symbol *symbol = lookup(name);
+        return symbol ? symbol->arraySize : 0;
+    }
+
+    ValueRange rangeOf(const Expression *expr) const
+    {
+        switch (expr->getType())
+        {
+        case NodeType::NumberExpr:
+        {
+            double value = static_cast<const NumberExpression *>(expr)->value;
+            // Checked before the cast, which is undefined outside the long long range
+            if (value != std::floor(value) || value < INT_MIN || value > INT_MAX)
+                return ValueRange::unknown();
+            return ValueRange::of(static_cast<long long>(value), static_cast<long long>(value));
+        }
+        case NodeType::IdentifierExpr:
+        {
+            const Symbol *symbol = lookup(static_cast<const IdentifierExpression *>(expr)->name);
+            return symbol ? symbol->range : ValueRange::unknown();
+        }
+        case NodeType::BinaryExpr:
+        {
+            auto *binary = static_cast<const BinaryExpression *>(expr);
+            ValueRange left = rangeOf(binary->left.get());
+            ValueRange right = rangeOf(binary->right.get());
+
+            if (!left.known || !right.known)
+            {
+                return isComparison(binary->op) ? ValueRange::of(0, 1) : ValueRange::unknown();
+            }
+
+            switch (binary->op)
+            {
+            case TokenType::GREATER:
+                return compare(left.min > right.max, left.max <= right.min);
+            case TokenType::GREATER_EQUAL:
+                return compare(left.min >= right.max, left.max < right.min);
+            case TokenType::LESS:
+                return compare(left.max < right.min, left.min >= right.max);
+            case TokenType::LESS_EQUAL:
+                return compare(left.max <= right.min, left.min > right.max);
+            case TokenType::EQUAL:
+                return compare(left.min == left.max && left == right, left.max < right.min || left.min > right.max);
+            case TokenType::NOT_EQUAL:
+                return compare(left.max < right.min || left.min > right.max, left.min == left.max && left == right);
+            case TokenType::PLUS:
+                return ValueRange::of(left.min + right.min, left.max + right.max);
+            case TokenType::MINUS:
+                return ValueRange::of(left.min - right.max, left.max - right.min);
+            case TokenType::MULTIPLY:
+            {
+                // Operands fit in int, so the products fit in long long
+                long long products[] = {left.min * right.min, left.min * right.max,
+                                        left.max * right.min, left.max * right.max};
+                return ValueRange::of(*std::min_element(products, products + 4),
+                                      *std::max_element(products, products + 4));
+            }
+            case TokenType::DIVIDE:
+            {
+                // With a divisor of constant sign the quotient is monotonic in
+                // both operands, so the corners bound it; INT_MIN / -1 falls
+                // outside the int range and comes out unknown
+                if (right.min <= 0 && right.max >= 0)
+                    return ValueRange::unknown();
+                long long quotients[] = {left.min / right.min, left.min / right.max,
+                                         left.max / right.min, left.max / right.max};
+                return ValueRange::of(*std::min_element(quotients, quotients + 4),
+                                      *std::max_element(quotients, quotients + 4));
+            }
+            default:
+                return ValueRange::unknown();
+            }
+        }
+        default:
+            // Calls and array elements can hold any value
+            return ValueRange::unknown();
+        }
+    }
+};
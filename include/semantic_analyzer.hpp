@@ -1,5 +1,9 @@
 #pragma once
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <memory>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -17,9 +21,14 @@ class Scope
 {
 public:
     std::unordered_map<std::string, bool> variables; // variable name -> is initialized
+    std::unordered_map<std::string, size_t> arrays;  // array name -> element count
+    std::unordered_map<std::string, size_t> slots;   // variable name -> first frame slot
     std::shared_ptr<Scope> parent;
+    size_t nextSlot; // first frame slot not used by this scope or its parents
 
-    explicit Scope(std::shared_ptr<Scope> parent = nullptr) : parent(parent) {}
+    // Slots are handed out past the parent's, so sibling scopes reuse the same range
+    explicit Scope(std::shared_ptr<Scope> parent = nullptr)
+        : parent(parent), nextSlot(parent ? parent->nextSlot : 0) {}
 
     bool isDeclared(const std::string &name) const
     {
@@ -40,13 +49,33 @@ public:
         return parent ? parent->isInitialized(name) : false;
     }
 
-    void declare(const std::string &name)
+    // Element count of the nearest declaration of name, or 0 for a scalar
+    size_t arraySize(const std::string &name) const
+    {
+        if (variables.find(name) != variables.end())
+        {
+            auto it = arrays.find(name);
+            return it != arrays.end() ? it->second : 0;
+        }
+        return parent ? parent->arraySize(name) : 0;
+    }
+
+    void declareArray(const std::string &name, size_t size)
+    {
+        declare(name, size);
+        variables[name] = true; // arrays are zero-initialized
+        arrays[name] = size;
+    }
+
+    void declare(const std::string &name, size_t slotCount = 1)
     {
         if (variables.find(name) != variables.end())
         {
             throw SemanticError("Variable '" + name + "' is already declared in this scope");
         }
         variables[name] = false;
+        slots[name] = nextSlot;
+        nextSlot += slotCount;
     }
 
     void initialize(const std::string &name)
@@ -68,6 +97,58 @@ class SemanticAnalyzer
 {
 private:
     std::shared_ptr<Scope> currentScope;
+    std::unordered_map<std::string, size_t> functions; // function name -> parameter count
+    std::unordered_map<std::string, size_t> frameSizes; // function name -> frame slots
+    size_t frameSize = 0;
+
+    // A number literal for a diagnostic. Converting a double outside the
+    // long long range is undefined, so such values keep their double form.
+    static std::string formatNumber(double value)
+    {
+        if (value == std::floor(value) && value >= static_cast<double>(LLONG_MIN) &&
+            value < -static_cast<double>(LLONG_MIN))
+            return std::to_string(static_cast<long long>(value));
+        std::ostringstream out;
+        out << value;
+        return out.str();
+    }
+
+    // Frame slots needed so far by the function being analyzed
+    void updateFrameSize()
+    {
+        frameSize = std::max(frameSize, currentScope->nextSlot);
+    }
+
+    void declareFunction(const FunctionDeclaration *func)
+    {
+        if (!functions.emplace(func->name, func->parameters.size()).second)
+        {
+            throw SemanticError("Function '" + func->name + "' is already declared");
+        }
+    }
+
+    void analyzeFunction(const FunctionDeclaration *func)
+    {
+        // Create new scope for function
+        auto functionScope = std::make_shared<Scope>(currentScope);
+        auto prevScope = currentScope;
+        currentScope = functionScope;
+
+        // Add parameters to scope; they take the first frame slots
+        frameSize = 0;
+        for (const auto &param : func->parameters)
+        {
+            currentScope->declare(param);
+            currentScope->initialize(param);
+        }
+        updateFrameSize();
+
+        // Analyze function body
+        analyzeStatement(func->body.get());
+
+        frameSizes[func->name] = frameSize;
+        currentScope = prevScope;
+    }
 
     void analyzeExpression(const Expression *expr)
     {
@@ -78,6 +159,11 @@ private:
             auto *binary = static_cast<const BinaryExpression *>(expr);
             analyzeExpression(binary->left.get());
             analyzeExpression(binary->right.get());
+            if (binary->op == TokenType::DIVIDE && binary->right->getType() == NodeType::NumberExpr &&
+                static_cast<const NumberExpression *>(binary->right.get())->value == 0)
+            {
+                throw SemanticError("Division by zero");
+            }
             break;
         }
         case NodeType::IdentifierExpr:
@@ -91,6 +177,57 @@ private:
             {
                 throw SemanticError("Use of uninitialized variable '" + id->name + "'");
             }
+            if (currentScope->arraySize(id->name) != 0)
+            {
+                throw SemanticError("Array '" + id->name + "' cannot be used as a value");
+            }
+            break;
+        }
+        case NodeType::IndexExpr:
+        {
+            auto *index = static_cast<const IndexExpression *>(expr);
+            if (!currentScope->isDeclared(index->array))
+            {
+                throw SemanticError("Use of undeclared array '" + index->array + "'");
+            }
+            size_t size = currentScope->arraySize(index->array);
+            if (size == 0)
+            {
+                throw SemanticError("Variable '" + index->array + "' is not an array");
+            }
+            analyzeExpression(index->index.get());
+
+            // Constant indices are checked here; the rest are left to runtime checks
+            if (index->index->getType() == NodeType::NumberExpr)
+            {
+                double value = static_cast<const NumberExpression *>(index->index.get())->value;
+                if (value < 0 || value >= static_cast<double>(size))
+                {
+                    throw SemanticError("Index " + formatNumber(value) +
+                                        " is out of bounds for array '" + index->array +
+                                        "' of size " + std::to_string(size));
+                }
+            }
+            break;
+        }
+        case NodeType::CallExpr:
+        {
+            auto *call = static_cast<const CallExpression *>(expr);
+            auto it = functions.find(call->callee);
+            if (it == functions.end())
+            {
+                throw SemanticError("Call to undeclared function '" + call->callee + "'");
+            }
+            if (it->second != call->arguments.size())
+            {
+                throw SemanticError("Function '" + call->callee + "' expects " +
+                                    std::to_string(it->second) + " argument(s), got " +
+                                    std::to_string(call->arguments.size()));
+            }
+            for (const auto &arg : call->arguments)
+            {
+                analyzeExpression(arg.get());
+            }
             break;
         }
         case NodeType::NumberExpr:
@@ -109,6 +246,7 @@ private:
         {
             auto *varDecl = static_cast<const VariableDeclaration *>(stmt);
             currentScope->declare(varDecl->name);
+            updateFrameSize();
             if (varDecl->initializer)
             {
                 analyzeExpression(varDecl->initializer.get());
@@ -116,6 +254,20 @@ private:
             }
             break;
         }
+        case NodeType::ArrayDecl:
+        {
+            auto *arrayDecl = static_cast<const ArrayDeclaration *>(stmt);
+            currentScope->declareArray(arrayDecl->name, arrayDecl->size);
+            updateFrameSize();
+            break;
+        }
+        case NodeType::AssignStmt:
+        {
+            auto *assign = static_cast<const AssignmentStatement *>(stmt);
+            analyzeExpression(assign->target.get());
+            analyzeExpression(assign->value.get());
+            break;
+        }
         case NodeType::IfStmt:
         {
             auto *ifStmt = static_cast<const IfStatement *>(stmt);
@@ -163,28 +315,72 @@ private:
 public:
     SemanticAnalyzer() : currentScope(std::make_shared<Scope>()) {}
 
-    void analyze(const Statement *root)
+    // Forgets every declaration so the analyzer can take a new program
+    void reset()
+    {
+        currentScope = std::make_shared<Scope>();
+        functions.clear();
+        frameSizes.clear();
+        frameSize = 0;
+    }
+
+    // Frame slots a function needs: one per scalar, one per array element,
+    // with variables of disjoint scopes sharing slots
+    size_t getFrameSize(const std::string &function) const
     {
-        if (root->getType() == NodeType::FunctionDecl)
+        auto it = frameSizes.find(function);
+        if (it == frameSizes.end())
+            throw std::out_of_range("No analyzed function '" + function + "'");
+        return it->second;
+    }
+
+    // For analyzing the functions of a program one at a time, as an editor
+    // does after a change: declare every signature, then analyze any function
+    void declareSignature(const std::string &name, size_t parameterCount)
+    {
+        functions[name] = parameterCount;
+    }
+
+    void removeSignature(const std::string &name)
+    {
+        functions.erase(name);
+    }
+
+    void analyzeDeclaredFunction(const FunctionDeclaration *func)
+    {
+        auto scope = currentScope;
+        try
         {
-            auto *func = static_cast<const FunctionDeclaration *>(root);
+            analyzeFunction(func);
+        }
+        catch (...)
+        {
+            currentScope = scope;
+            throw;
+        }
+    }
 
-            // Create new scope for function
-            auto functionScope = std::make_shared<Scope>(currentScope);
-            auto prevScope = currentScope;
-            currentScope = functionScope;
+    void analyze(const Statement *root)
+    {
+        if (root->getType() == NodeType::Program)
+        {
+            auto *program = static_cast<const Program *>(root);
 
-            // Add parameters to scope
-            for (const auto &param : func->parameters)
+            // Declare every function first so calls may refer to later siblings
+            for (const auto &func : program->functions)
             {
-                currentScope->declare(param);
-                currentScope->initialize(param);
+                declareFunction(func.get());
             }
-
-            // Analyze function body
-            analyzeStatement(func->body.get());
-
-            currentScope = prevScope;
+            for (const auto &func : program->functions)
+            {
+                analyzeFunction(func.get());
+            }
+        }
+        else if (root->getType() == NodeType::FunctionDecl)
+        {
+            auto *func = static_cast<const FunctionDeclaration *>(root);
+            declareFunction(func);
+            analyzeFunction(func);
         }
         else
         {
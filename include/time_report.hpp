@@ -0,0 +1,175 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "alloc_tracker.hpp"
+#include "perf_counters.hpp"
+
+// Wall time of one compiler phase and how much input it consumed
+struct PhaseTiming
+{
+    std::string name;
+    double seconds = 0;
+    size_t units = 0;    // bytes, tokens or AST nodes processed
+    std::string unit;    // what `units` counts
+    PerfSample counters; // hardware counters, when collected
+    AllocationStats allocations; // heap use, when tracked
+};
+
+// Per-phase timing table, the equivalent of -ftime-report. Phases are kept
+// in the order they first ran; timing the same phase again accumulates.
+class TimeReport
+{
+private:
+    std::vector<PhaseTiming> phases;
+    std::string countersUnavailable; // why counters were requested but not collected
+    bool allocationsUnavailable = false;
+
+    PhaseTiming &phase(const std::string &name, const std::string &unit)
+    {
+        for (auto &timing : phases)
+        {
+            if (timing.name == name)
+                return timing;
+        }
+        PhaseTiming timing;
+        timing.name = name;
+        timing.unit = unit;
+        phases.push_back(timing);
+        return phases.back();
+    }
+
+    static std::string formatRate(double perSecond, const std::string &unit)
+    {
+        const char *prefixes[] = {"", "K", "M", "G"};
+        int prefix = 0;
+        while (perSecond >= 1000.0 && prefix < 3)
+        {
+            perSecond /= 1000.0;
+            prefix++;
+        }
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%.2f %s%s/s", perSecond, prefixes[prefix], unit.c_str());
+        return buffer;
+    }
+
+    static void printCounter(std::FILE *out, const PerfSample &sample, size_t counter, int width)
+    {
+        if (sample.valid[counter])
+            std::fprintf(out, " %*llu", width, static_cast<unsigned long long>(sample.values[counter]));
+        else
+            std::fprintf(out, " %*s", width, "-");
+    }
+
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void record(const std::string &name, Clock::time_point start, size_t units, const std::string &unit,
+                const PerfSample *counters = nullptr, const AllocationStats *allocations = nullptr)
+    {
+        PhaseTiming &timing = phase(name, unit);
+        timing.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        timing.units += units;
+        if (counters)
+            timing.counters += *counters;
+        if (allocations)
+            timing.allocations += *allocations;
+    }
+
+    void setCountersUnavailable(const std::string &reason) { countersUnavailable = reason; }
+    void setAllocationsUnavailable() { allocationsUnavailable = true; }
+
+    void merge(const TimeReport &other)
+    {
+        for (const auto &timing : other.phases)
+        {
+            PhaseTiming &total = phase(timing.name, timing.unit);
+            total.seconds += timing.seconds;
+            total.units += timing.units;
+            total.counters += timing.counters;
+            total.allocations += timing.allocations;
+        }
+        if (countersUnavailable.empty())
+            countersUnavailable = other.countersUnavailable;
+        allocationsUnavailable = allocationsUnavailable || other.allocationsUnavailable;
+    }
+
+    bool empty() const { return phases.empty(); }
+
+    void clear()
+    {
+        phases.clear();
+        countersUnavailable.clear();
+        allocationsUnavailable = false;
+    }
+
+    const std::vector<PhaseTiming> &getPhases() const { return phases; }
+
+    void print(std::FILE *out) const
+    {
+        double total = 0;
+        for (const auto &timing : phases)
+            total += timing.seconds;
+
+        std::fprintf(out, "===------------------------------------------------------------===\n");
+        std::fprintf(out, "                      Compiler phase time report\n");
+        std::fprintf(out, "===------------------------------------------------------------===\n");
+        std::fprintf(out, "%-12s %12s %8s %14s  %s\n", "Phase", "Time (ms)", "%", "Input", "Throughput");
+        for (const auto &timing : phases)
+        {
+            double percent = total > 0 ? timing.seconds * 100.0 / total : 0;
+            std::string rate = timing.seconds > 0 ? formatRate(timing.units / timing.seconds, timing.unit) : "-";
+            std::fprintf(out, "%-12s %12.3f %7.1f%% %8zu %-5s  %s\n", timing.name.c_str(), timing.seconds * 1000.0,
+                         percent, timing.units, timing.unit.c_str(), rate.c_str());
+        }
+        std::fprintf(out, "%-12s %12.3f %7.1f%%\n", "total", total * 1000.0, 100.0);
+
+        bool counted = false;
+        for (const auto &timing : phases)
+            counted = counted || timing.counters.any();
+        if (counted)
+        {
+            std::fprintf(out, "\n%-12s %16s %16s %6s %14s %14s\n", "Phase", PerfSample::name(0),
+                         PerfSample::name(1), "IPC", PerfSample::name(2), PerfSample::name(3));
+            for (const auto &timing : phases)
+            {
+                const PerfSample &c = timing.counters;
+                std::fprintf(out, "%-12s", timing.name.c_str());
+                for (size_t i = 0; i < 2; i++)
+                    printCounter(out, c, i, 16);
+                if (c.valid[0] && c.valid[1] && c.values[0] != 0)
+                    std::fprintf(out, " %6.2f", static_cast<double>(c.values[1]) / c.values[0]);
+                else
+                    std::fprintf(out, " %6s", "-");
+                for (size_t i = 2; i < PerfSample::COUNT; i++)
+                    printCounter(out, c, i, 14);
+                std::fprintf(out, "\n");
+            }
+        }
+        else if (!countersUnavailable.empty())
+        {
+            std::fprintf(out, "\nHardware counters unavailable (%s)\n", countersUnavailable.c_str());
+        }
+
+        bool tracked = false;
+        for (const auto &timing : phases)
+            tracked = tracked || timing.allocations.valid;
+        if (tracked)
+        {
+            std::fprintf(out, "\n%-12s %12s %14s %14s %10s\n", "Phase", "Allocations", "Bytes", "Peak bytes",
+                         "Bytes/unit");
+            for (const auto &timing : phases)
+            {
+                const AllocationStats &a = timing.allocations;
+                double perUnit = timing.units ? static_cast<double>(a.bytes) / timing.units : 0;
+                std::fprintf(out, "%-12s %12zu %14zu %14zu %10.1f\n", timing.name.c_str(), a.count, a.bytes,
+                             a.peak, perUnit);
+            }
+        }
+        else if (allocationsUnavailable)
+        {
+            std::fprintf(out, "\nAllocation tracking unavailable in this build\n");
+        }
+    }
+};
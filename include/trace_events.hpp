@@ -0,0 +1,171 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// One complete ("X") event: a named span on one thread
+struct TraceEvent
+{
+    std::string name;
+    std::string category; // "phase", "file", "function" or "pass"
+    double start = 0;     // microseconds since the recorder was created
+    double duration = 0;
+    int thread = 0;
+    std::vector<std::pair<std::string, std::string>> args;
+};
+
+// Collects spans from any thread and writes them in the Chrome trace-event
+// format, which chrome://tracing and Perfetto open directly. Threads get
+// small ids in the order they first record, and can be given a display name.
+class TraceRecorder
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Args = std::vector<std::pair<std::string, std::string>>;
+
+private:
+    Clock::time_point origin = Clock::now();
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    std::unordered_map<std::thread::id, int> threadIds;
+    std::vector<std::string> threadNames; // indexed by thread id
+
+    double microseconds(Clock::time_point time) const
+    {
+        return std::chrono::duration<double, std::micro>(time - origin).count();
+    }
+
+    // Caller holds the mutex
+    int currentThread()
+    {
+        auto inserted = threadIds.emplace(std::this_thread::get_id(), static_cast<int>(threadIds.size()));
+        if (inserted.second)
+            threadNames.emplace_back();
+        return inserted.first->second;
+    }
+
+    static void writeString(std::ostream &out, const std::string &value)
+    {
+        out << '"';
+        for (char c : value)
+        {
+            switch (c)
+            {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            case '\n':
+                out << "\\n";
+                break;
+            case '\t':
+                out << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out << escaped;
+                }
+                else
+                {
+                    out << c;
+                }
+            }
+        }
+        out << '"';
+    }
+
+    static void writeArgs(std::ostream &out, const Args &args)
+    {
+        out << "{";
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            if (i != 0)
+                out << ",";
+            writeString(out, args[i].first);
+            out << ":";
+            writeString(out, args[i].second);
+        }
+        out << "}";
+    }
+
+public:
+    // Names the calling thread; the first name given wins
+    void nameThread(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string &current = threadNames[currentThread()];
+        if (current.empty())
+            current = name;
+    }
+
+    // Records a span from `start` until now on the calling thread
+    void record(const std::string &name, const char *category, Clock::time_point start, Args args = Args())
+    {
+        Clock::time_point end = Clock::now();
+        TraceEvent event;
+        event.name = name;
+        event.category = category;
+        event.start = microseconds(start);
+        event.duration = microseconds(end) - event.start;
+        event.args = std::move(args);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        event.thread = currentThread();
+        events.push_back(std::move(event));
+    }
+
+    void write(std::ostream &out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        for (size_t thread = 0; thread < threadNames.size(); thread++)
+        {
+            if (threadNames[thread].empty())
+                continue;
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+                << ",\"args\":{\"name\":";
+            writeString(out, threadNames[thread]);
+            out << "}}";
+            first = false;
+        }
+
+        char times[64];
+        for (const auto &event : events)
+        {
+            out << (first ? "" : ",\n") << "{\"name\":";
+            writeString(out, event.name);
+            out << ",\"cat\":";
+            writeString(out, event.category);
+            std::snprintf(times, sizeof(times), ",\"ts\":%.3f,\"dur\":%.3f", event.start, event.duration);
+            out << ",\"ph\":\"X\"" << times << ",\"pid\":1,\"tid\":" << event.thread << ",\"args\":";
+            writeArgs(out, event.args);
+            out << "}";
+            first = false;
+        }
+        out << "\n]}\n";
+    }
+
+    void writeFile(const std::string &path)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            throw std::runtime_error("Cannot open file '" + path + "'");
+        write(file);
+        if (!file)
+            throw std::runtime_error("Cannot write trace to '" + path + "'");
+    }
+};
@@ -51,6 +51,12 @@ inline std::string tokenTypeToString(TokenType type)
         return "LBRACE";
     case TokenType::RBRACE:
         return "RBRACE";
+    case TokenType::LBRACKET:
+        return "LBRACKET";
+    case TokenType::RBRACKET:
+        return "RBRACKET";
+    case TokenType::COMMA:
+        return "COMMA";
     case TokenType::SEMICOLON:
         return "SEMICOLON";
     case TokenType::EOF_TOKEN:
@@ -0,0 +1,57 @@
+#include "alloc_tracker.hpp"
+#include <cstdlib>
+#include <new>
+
+// Replacement global allocation functions feeding AllocationTracker. Sizes
+// are taken from malloc_usable_size, so a block is credited with the same
+// size when it is freed, whichever operator delete the caller picks. The
+// size is only looked up while counting is enabled. Other C libraries keep
+// the default allocation functions.
+#ifdef __GLIBC__
+#include <malloc.h>
+
+namespace
+{
+    const bool hooksInstalled = (AllocationTracker::markInstalled(), true);
+
+    void *allocate(size_t size)
+    {
+        void *block = std::malloc(size == 0 ? 1 : size);
+        if (block && AllocationTracker::enabled())
+            AllocationTracker::noteAllocation(malloc_usable_size(block));
+        return block;
+    }
+
+    void deallocate(void *block)
+    {
+        if (block && AllocationTracker::enabled())
+            AllocationTracker::noteDeallocation(malloc_usable_size(block));
+        std::free(block);
+    }
+
+    void *allocateOrThrow(size_t size)
+    {
+        void *block;
+        while (!(block = allocate(size)))
+        {
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+        return block;
+    }
+}
+
+void *operator new(size_t size) { return allocateOrThrow(size); }
+void *operator new[](size_t size) { return allocateOrThrow(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+
+void operator delete(void *block) noexcept { deallocate(block); }
+void operator delete[](void *block) noexcept { deallocate(block); }
+void operator delete(void *block, size_t) noexcept { deallocate(block); }
+void operator delete[](void *block, size_t) noexcept { deallocate(block); }
+void operator delete(void *block, const std::nothrow_t &) noexcept { deallocate(block); }
+void operator delete[](void *block, const std::nothrow_t &) noexcept { deallocate(block); }
+#endif
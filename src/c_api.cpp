@@ -0,0 +1,195 @@
+#include "coulstock.h"
+#include <cstring>
+#include <new>
+#include <sstream>
+#include "ast_printer.hpp"
+#include "compiler.hpp"
+
+struct coulstock_context
+{
+    CompilationContext compilation;
+    std::string source; // reused copy of the caller's buffer
+    std::string failure; // message of a failure outside compilation
+    std::string astText;
+    bool astTextCurrent = false;
+
+    explicit coulstock_context(const CompileOptions &options) : compilation(options) {}
+
+    const Program *program() const
+    {
+        return static_cast<const Program *>(compilation.getAST());
+    }
+};
+
+namespace
+{
+    coulstock_string view(const std::string &value)
+    {
+        return coulstock_string{value.data(), value.size()};
+    }
+
+    // Runs `body`, turning exceptions into a status and message
+    template <typename Body>
+    coulstock_status guarded(coulstock_context *context, Body body)
+    {
+        if (!context)
+            return COULSTOCK_INVALID_ARGUMENT;
+        context->failure.clear();
+        try
+        {
+            return body();
+        }
+        catch (const std::exception &e)
+        {
+            try
+            {
+                context->failure = std::string("Error: ") + e.what();
+            }
+            catch (...)
+            {
+            }
+            return COULSTOCK_INTERNAL_ERROR;
+        }
+        catch (...)
+        {
+            return COULSTOCK_INTERNAL_ERROR;
+        }
+    }
+}
+
+extern "C"
+{
+    int coulstock_api_version(void) { return COULSTOCK_API_VERSION; }
+
+    void coulstock_options_init(coulstock_options *options)
+    {
+        if (!options)
+            return;
+        CompileOptions defaults;
+        options->struct_size = sizeof(coulstock_options);
+        options->opt_level = defaults.optLevel;
+        options->jobs = defaults.jobs;
+        options->budget_seconds = defaults.budget.seconds;
+        options->budget_work = defaults.budget.work;
+    }
+
+    coulstock_context *coulstock_context_create(const coulstock_options *options)
+    {
+        coulstock_options known;
+        coulstock_options_init(&known);
+        if (options)
+        {
+            // Fields past the caller's struct_size keep their defaults
+            size_t size = options->struct_size < sizeof(known) ? options->struct_size : sizeof(known);
+            std::memcpy(&known, options, size);
+            known.struct_size = sizeof(known);
+        }
+
+        CompileOptions compileOptions;
+        compileOptions.optLevel = known.opt_level;
+        compileOptions.jobs = known.jobs;
+        compileOptions.budget.seconds = known.budget_seconds;
+        compileOptions.budget.work = known.budget_work;
+        try
+        {
+            return new coulstock_context(compileOptions);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    void coulstock_context_destroy(coulstock_context *context)
+    {
+        delete context;
+    }
+
+    void coulstock_context_reset(coulstock_context *context)
+    {
+        if (!context)
+            return;
+        context->compilation.reset();
+        context->failure.clear();
+        context->astText.clear();
+        context->astTextCurrent = false;
+    }
+
+    coulstock_status coulstock_compile(coulstock_context *context, const char *source, size_t size)
+    {
+        if (!source && size != 0)
+            return COULSTOCK_INVALID_ARGUMENT;
+        return guarded(context, [&]()
+                       {
+                           context->astTextCurrent = false;
+                           context->source.assign(source ? source : "", size);
+                           return context->compilation.compile(context->source) ? COULSTOCK_OK : COULSTOCK_COMPILE_ERROR; });
+    }
+
+    coulstock_string coulstock_error(const coulstock_context *context)
+    {
+        if (!context)
+            return coulstock_string{"", 0};
+        return view(context->failure.empty() ? context->compilation.getError() : context->failure);
+    }
+
+    size_t coulstock_function_count(const coulstock_context *context)
+    {
+        if (!context || !context->program())
+            return 0;
+        return context->program()->functions.size();
+    }
+
+    coulstock_string coulstock_function_name(const coulstock_context *context, size_t index)
+    {
+        if (index >= coulstock_function_count(context))
+            return coulstock_string{"", 0};
+        return view(context->program()->functions[index]->name);
+    }
+
+    coulstock_status coulstock_frame_size(const coulstock_context *context, size_t index, size_t *slots)
+    {
+        if (!context || !slots)
+            return COULSTOCK_INVALID_ARGUMENT;
+        if (!context->program())
+            return COULSTOCK_NO_RESULT;
+        if (index >= context->program()->functions.size())
+            return COULSTOCK_INVALID_ARGUMENT;
+        const auto &frameSizes = context->compilation.getResult().frameSizes;
+        auto it = frameSizes.find(context->program()->functions[index]->name);
+        *slots = it == frameSizes.end() ? 0 : it->second;
+        return COULSTOCK_OK;
+    }
+
+    coulstock_status coulstock_module(coulstock_context *context, coulstock_bytes *module)
+    {
+        if (!module)
+            return COULSTOCK_INVALID_ARGUMENT;
+        return guarded(context, [&]()
+                       {
+                           if (!context->program())
+                               return COULSTOCK_NO_RESULT;
+                           const std::vector<uint8_t> &bytes = context->compilation.getModule();
+                           *module = coulstock_bytes{bytes.data(), bytes.size()};
+                           return COULSTOCK_OK; });
+    }
+
+    coulstock_status coulstock_ast_text(coulstock_context *context, coulstock_string *text)
+    {
+        if (!text)
+            return COULSTOCK_INVALID_ARGUMENT;
+        return guarded(context, [&]()
+                       {
+                           if (!context->program())
+                               return COULSTOCK_NO_RESULT;
+                           if (!context->astTextCurrent)
+                           {
+                               std::ostringstream out;
+                               printAST(out, context->compilation.getAST());
+                               context->astText = out.str();
+                               context->astTextCurrent = true;
+                           }
+                           *text = view(context->astText);
+                           return COULSTOCK_OK; });
+    }
+}
@@ -1,127 +1,566 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <sstream>
 #include "lexer.hpp"
 #include "parser.hpp"
 #include "utils.hpp"
 #include "semantic_analyzer.hpp"
+#include "passes.hpp"
+#include "parallel_pipeline.hpp"
+#include "module_format.hpp"
+#include "ast_printer.hpp"
+#include "compiler.hpp"
+#include "thread_pool.hpp"
+#include "compile_server.hpp"
+#include "language_server.hpp"
 
-// Helper function to print the AST
-void printAST(const ASTNode *node, int indent = 0)
+struct DriverOptions
 {
-    std::string indentation(indent * 2, ' ');
+    CompileOptions compile;
+    bool passStats = false;
+    bool dumpAst = false;
+    std::string emitModule;
+    std::string loadModule;
+    std::string serveSocket;
+    size_t cacheEntries = 4096; // results kept by the compile server, 0 = unbounded
+    std::string connectSocket;
+    bool stopServer = false;
+    bool languageServer = false;
+    std::string traceFile;
+    std::string compileFlag; // first flag that changes how inputs are compiled or reported
+    std::vector<std::string> inputs;
+};
 
-    switch (node->getType())
-    {
-    case NodeType::FunctionDecl:
+// Per-pass wall time and AST size change
+void printPassStatistics(const std::vector<PassStatistics> &statistics)
+{
+    std::printf("%-28s %12s %14s %13s %9s %9s\n", "Pass", "Time (ms)", "Nodes before", "Nodes after",
+                "Changed", "Skipped");
+    for (const auto &stats : statistics)
     {
-        auto *func = static_cast<const FunctionDeclaration *>(node);
-        std::cout << indentation << "Function: " << func->name << std::endl;
-        printAST(func->body.get(), indent + 1);
-        break;
+        std::printf("%-28s %12.3f %14zu %13zu %9zu %9zu\n", stats.name.c_str(), stats.seconds * 1000.0,
+                    stats.nodesBefore, stats.nodesAfter, stats.changedFunctions, stats.skippedFunctions.size());
     }
-    case NodeType::BlockStmt:
+}
+
+// Passes dropped because a function ran out of compile budget
+void printSkippedPasses(const std::vector<PassStatistics> &statistics)
+{
+    for (const auto &stats : statistics)
     {
-        auto *block = static_cast<const BlockStatement *>(node);
-        std::cout << indentation << "Block:" << std::endl;
-        for (const auto &stmt : block->statements)
+        for (const auto &function : stats.skippedFunctions)
         {
-            printAST(stmt.get(), indent + 1);
+            std::cout << "Skipped " << stats.name << " in '" << function << "' (over budget)\n";
         }
-        break;
     }
-    case NodeType::ReturnStmt:
-    {
-        auto *ret = static_cast<const ReturnStatement *>(node);
-        std::cout << indentation << "Return:" << std::endl;
-        printAST(ret->value.get(), indent + 1);
-        break;
-    }
-    case NodeType::IfStmt:
+}
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options] [file... | @response-file...]\n"
+              << "  -O0|-O1|-O2            optimization level (default -O1)\n"
+              << "  -j N                   worker threads, a positive integer (default 1)\n"
+              << "  --budget-us N          per-function optimization time budget\n"
+              << "  --budget-nodes N       per-function optimization work budget\n"
+              << "  --pass-stats           print per-pass statistics\n"
+              << "  --time-report          print time and throughput of each compiler phase\n"
+              << "  --perf-counters        add hardware counters to the time report (Linux)\n"
+              << "  --alloc-stats          add heap allocations to the time report\n"
+              << "  --trace FILE           write a Chrome trace of phases, functions and passes\n"
+              << "  --dump-ast             print the optimized AST of each input\n"
+              << "  --emit-module FILE     write the compiled module (single input)\n"
+              << "  --load-module FILE     print a compiled module\n"
+              << "  --serve SOCKET         run as a compile server on a Unix socket\n"
+              << "  --cache-entries N      with --serve, results to cache (default 4096, 0 = no limit)\n"
+              << "  --connect SOCKET       send the inputs to a compile server\n"
+              << "  --stop-server          with --connect, shut the server down\n"
+              << "  --lsp                  run as a language server on stdin/stdout\n"
+              << "Without input files the built-in example program is compiled.\n";
+}
+
+std::string readFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error("Cannot open file '" + path + "'");
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// Replaces every @file argument by the whitespace-separated arguments it
+// contains, recursively
+void expandArguments(const std::vector<std::string> &args, std::vector<std::string> &expanded, int depth = 0)
+{
+    for (const auto &arg : args)
     {
-        auto *ifStmt = static_cast<const IfStatement *>(node);
-        std::cout << indentation << "If Statement:" << std::endl;
-        std::cout << indentation << "  Condition:" << std::endl;
-        printAST(ifStmt->condition.get(), indent + 2);
-        std::cout << indentation << "  Then:" << std::endl;
-        printAST(ifStmt->thenBranch.get(), indent + 2);
-        if (ifStmt->elseBranch)
+        if (arg.size() > 1 && arg[0] == '@')
         {
-            std::cout << indentation << "  Else:" << std::endl;
-            printAST(ifStmt->elseBranch.get(), indent + 2);
+            if (depth > 8)
+                throw std::runtime_error("Response files nested too deeply at '" + arg + "'");
+            std::istringstream contents(readFile(arg.substr(1)));
+            std::vector<std::string> nested;
+            std::string word;
+            while (contents >> word)
+                nested.push_back(word);
+            expandArguments(nested, expanded, depth + 1);
+        }
+        else
+        {
+            expanded.push_back(arg);
         }
-        break;
-    }
-    case NodeType::VarDecl:
-    {
-        auto *var = static_cast<const VariableDeclaration *>(node);
-        std::cout << indentation << "Variable Declaration: " << var->name << std::endl;
-        std::cout << indentation << "  Initializer:" << std::endl;
-        printAST(var->initializer.get(), indent + 2);
-        break;
     }
-    case NodeType::BinaryExpr:
+}
+
+// Returns false on a malformed command line
+bool parseArguments(const std::vector<std::string> &args, DriverOptions &options)
+{
+    for (size_t i = 0; i < args.size(); i++)
     {
-        auto *binary = static_cast<const BinaryExpression *>(node);
-        std::cout << indentation << "Binary Expression:" << std::endl;
-        std::cout << indentation << "  Left:" << std::endl;
-        printAST(binary->left.get(), indent + 2);
-        std::cout << indentation << "  Operator: " << tokenTypeToString(binary->op) << std::endl;
-        std::cout << indentation << "  Right:" << std::endl;
-        printAST(binary->right.get(), indent + 2);
-        break;
+        const std::string &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        if (options.compileFlag.empty() &&
+            (arg == "-O0" || arg == "-O1" || arg == "-O2" || arg == "--budget-us" || arg == "--budget-nodes" ||
+             arg == "--pass-stats" || arg == "--time-report" || arg == "--perf-counters" ||
+             arg == "--alloc-stats" || arg == "--trace" || arg == "--emit-module"))
+            options.compileFlag = arg;
+
+        if (arg.compare(0, 2, "-j") == 0)
+        {
+            // -jN or -j N, with N a positive integer
+            std::string count = arg.size() > 2 ? arg.substr(2) : (hasValue ? args[++i] : "");
+            if (count.empty() || count.size() > 6 || count.find_first_not_of("0123456789") != std::string::npos)
+                return false;
+            unsigned jobs = static_cast<unsigned>(std::strtoul(count.c_str(), nullptr, 10));
+            if (jobs == 0)
+                return false;
+            options.compile.jobs = jobs;
+        }
+        else if (arg == "-O0" || arg == "-O1" || arg == "-O2")
+        {
+            options.compile.optLevel = arg[2] - '0';
+        }
+        else if (arg == "--budget-us" && hasValue)
+        {
+            options.compile.budget.seconds = std::strtod(args[++i].c_str(), nullptr) / 1e6;
+        }
+        else if (arg == "--budget-nodes" && hasValue)
+        {
+            options.compile.budget.work = std::strtoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (arg == "--emit-module" && hasValue)
+        {
+            options.emitModule = args[++i];
+        }
+        else if (arg == "--load-module" && hasValue)
+        {
+            options.loadModule = args[++i];
+        }
+        else if (arg == "--serve" && hasValue)
+        {
+            options.serveSocket = args[++i];
+        }
+        else if (arg == "--cache-entries" && hasValue)
+        {
+            options.cacheEntries = std::strtoul(args[++i].c_str(), nullptr, 10);
+        }
+        else if (arg == "--connect" && hasValue)
+        {
+            options.connectSocket = args[++i];
+        }
+        else if (arg == "--trace" && hasValue)
+        {
+            options.traceFile = args[++i];
+        }
+        else if (arg == "--lsp")
+        {
+            options.languageServer = true;
+        }
+        else if (arg == "--stop-server")
+        {
+            options.stopServer = true;
+        }
+        else if (arg == "--pass-stats")
+        {
+            options.passStats = true;
+        }
+        else if (arg == "--time-report")
+        {
+            options.compile.timeReport = true;
+        }
+        else if (arg == "--alloc-stats")
+        {
+            options.compile.timeReport = true;
+            options.compile.allocationStats = true;
+        }
+        else if (arg == "--perf-counters")
+        {
+            options.compile.timeReport = true;
+            options.compile.perfCounters = true;
+        }
+        else if (arg == "--dump-ast")
+        {
+            options.dumpAst = true;
+        }
+        else if (!arg.empty() && arg[0] != '-')
+        {
+            options.inputs.push_back(arg);
+        }
+        else
+        {
+            return false;
+        }
     }
-    case NodeType::NumberExpr:
+
+    // A server runs until it is stopped, so its trace would grow without bound
+    if (!options.serveSocket.empty() && !options.traceFile.empty())
     {
-        auto *num = static_cast<const NumberExpression *>(node);
-        std::cout << indentation << "Number: " << num->value << std::endl;
-        break;
+        std::cerr << "--trace cannot be used with --serve" << std::endl;
+        return false;
     }
-    case NodeType::IdentifierExpr:
+    // Requests carry only the name and source; the server compiles with its own options
+    if (!options.connectSocket.empty() && !options.compileFlag.empty())
     {
-        auto *id = static_cast<const IdentifierExpression *>(node);
-        std::cout << indentation << "Identifier: " << id->name << std::endl;
-        break;
-    }
+        std::cerr << options.compileFlag << " cannot be used with --connect; the server compiles with the options it was started with"
+                  << std::endl;
+        return false;
     }
+    return true;
 }
 
-int main()
+// Compiles the built-in example, printing every phase
+int runExample(const DriverOptions &options)
 {
     std::string input = R"(
+int sum(int n, int acc) {
+    if (n > 0) {
+        return sum(n - 1, acc + n);
+    }
+    return acc;
+}
+
 int main() {
     int x = 42;
+    int buf[8];
+    int i = x - 40;
+    buf[i] = x;
     if (x > 0) {
-        return x * 2;
+        return sum(buf[i + 1], 0) * 2;
     }
     return 0;
 }
 )";
 
+    TimeReport timings;
+    PhaseTimer phase(options.compile, timings);
+
+    // Lexical analysis
+    phase.begin();
+    Lexer lexer(input);
+    auto tokens = lexer.tokenize();
+    phase.end("lex", input.size(), "B");
+
+    std::cout << "Tokens:\n";
+    for (const auto &token : tokens)
+    {
+        std::cout << "Token: " << tokenTypeToString(token.type)
+                  << " | Value: '" << token.value
+                  << "' | Line: " << token.line
+                  << " | Column: " << token.column << std::endl;
+    }
+
+    // Parsing
+    phase.begin();
+    Parser parser(tokens);
+    auto ast = parser.parseProgram();
+    phase.end("parse", tokens.size(), "tok");
+    size_t nodes = options.compile.timeReport ? countProgramNodes(ast.get()) : 0;
+
+    // Semantic Analysis
+    std::cout << "\nPerforming semantic analysis...\n";
+    phase.begin();
+    SemanticAnalyzer analyzer;
+    analyzer.analyze(ast.get());
+    phase.end("analyze", nodes, "node");
+    std::cout << "Semantic analysis completed successfully!\n";
+    for (const auto &func : static_cast<const Program *>(ast.get())->functions)
+    {
+        std::cout << "Function '" << func->name << "' needs " << analyzer.getFrameSize(func->name)
+                  << " frame slot(s)\n";
+    }
+
+    // Optimization
+    phase.begin();
+    int optLevel = options.compile.optLevel;
+    PassBudget budget = options.compile.budget;
+    ParallelPipeline pipeline([optLevel, budget]()
+                              {
+                                  PassManager passes = createPipeline(optLevel);
+                                  passes.setBudget(budget);
+                                  return passes; },
+                              options.compile.jobs);
+    pipeline.setTrace(options.compile.trace);
+    pipeline.run(ast.get());
+    phase.end("optimize", nodes, "node");
+    if (budget.limited())
+    {
+        printSkippedPasses(pipeline.getStatistics());
+    }
+    if (options.passStats)
+    {
+        std::cout << "\nPass statistics (-O" << optLevel << "):\n";
+        printPassStatistics(pipeline.getStatistics());
+    }
+
+    if (!options.emitModule.empty())
+    {
+        phase.begin();
+        ModuleWriter().writeFile(*static_cast<const Program *>(ast.get()), options.emitModule);
+        phase.end("emit", nodes, "node");
+        std::cout << "\nWrote module " << options.emitModule << "\n";
+    }
+    if (options.compile.timeReport)
+    {
+        std::cout << "\n" << std::flush;
+        timings.print(stdout);
+    }
+
+    std::cout << "\nAST:\n";
+    printAST(std::cout, ast.get());
+    return 0;
+}
+
+// What one input contributes to the output, printed in command-line order
+struct FileReport
+{
+    bool succeeded = false;
+    std::string output;
+    std::vector<PassStatistics> statistics;
+    TimeReport timings;
+};
+
+FileReport compileFile(const std::string &path, const DriverOptions &options, CompileOptions compileOptions)
+{
+    FileReport report;
+    std::string source;
+    try
+    {
+        source = readFile(path);
+    }
+    catch (const std::exception &e)
+    {
+        report.output = path + ": Error: " + e.what() + "\n";
+        return report;
+    }
+
+    // Each pool thread keeps one context, so its buffers are reused across files
+    thread_local CompilationContext context;
+    context.setOptions(compileOptions);
+    if (!context.compile(source))
+    {
+        report.output = path + ": " + context.getError() + "\n";
+        return report;
+    }
+
+    const CompileResult &result = context.getResult();
+    report.succeeded = true;
+    report.statistics = result.statistics;
+    report.timings = result.timings;
+    if (options.dumpAst)
+    {
+        std::ostringstream out;
+        out << path << ":\n";
+        printAST(out, result.ast.get());
+        report.output = out.str();
+    }
+    if (!options.emitModule.empty())
+    {
+        PhaseTimer phase(compileOptions, report.timings);
+        phase.begin();
+        ModuleWriter().writeFile(*static_cast<const Program *>(result.ast.get()), options.emitModule);
+        phase.end("emit", compileOptions.timeReport ? countProgramNodes(result.ast.get()) : 0, "node");
+    }
+    return report;
+}
+
+// Compiles every input on a fixed-size pool. Reports are printed in input
+// order as soon as all earlier inputs are done, so output does not depend
+// on scheduling.
+int runBatch(const DriverOptions &options)
+{
+    if (!options.emitModule.empty() && options.inputs.size() != 1)
+    {
+        std::cerr << "Error: --emit-module needs exactly one input file" << std::endl;
+        return 1;
+    }
+
+    // Files are the unit of parallelism, so each compiles its functions serially
+    CompileOptions compileOptions = options.compile;
+    compileOptions.jobs = 1;
+
+    ThreadPool pool(std::min<size_t>(options.compile.jobs, options.inputs.size()));
+    std::vector<std::future<FileReport>> reports;
+    reports.reserve(options.inputs.size());
+    for (const auto &path : options.inputs)
+    {
+        reports.push_back(pool.submit([&path, &options, compileOptions]()
+                                      {
+                                          TraceRecorder *trace = compileOptions.trace;
+                                          if (trace)
+                                              trace->nameThread("batch worker");
+                                          auto start = TraceRecorder::Clock::now();
+                                          FileReport report = compileFile(path, options, compileOptions);
+                                          if (trace)
+                                              trace->record(path, "file", start, {{"succeeded", report.succeeded ? "true" : "false"}});
+                                          return report; }));
+    }
+
+    size_t failed = 0;
+    std::vector<PassStatistics> statistics;
+    TimeReport timings;
+    for (auto &pending : reports)
+    {
+        FileReport report = pending.get();
+        (report.succeeded ? std::cout : std::cerr) << report.output;
+        if (report.succeeded)
+        {
+            mergeStatistics(statistics, report.statistics);
+            timings.merge(report.timings);
+        }
+        else
+        {
+            failed++;
+        }
+    }
+
+    if (options.passStats)
+    {
+        std::cout << "\nPass statistics (-O" << options.compile.optLevel << "):\n";
+        printPassStatistics(statistics);
+    }
+    if (options.compile.timeReport && !timings.empty())
+    {
+        // Phase times are summed over inputs, so with -j they exceed wall time
+        std::cout << "\n" << std::flush;
+        timings.print(stdout);
+    }
+    if (failed != 0 || options.inputs.size() > 1)
+    {
+        std::cerr << options.inputs.size() << " file(s) compiled, " << failed << " failed" << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+// Keeps the compiler resident, answering requests until a client stops it
+int runServer(const DriverOptions &options)
+{
+    CompileOptions compileOptions = options.compile;
+    compileOptions.jobs = 1;
+    CompileServer server(options.serveSocket, compileOptions, options.compile.jobs, options.cacheEntries);
+    std::cerr << "Compile server listening on " << options.serveSocket << std::endl;
+    server.serve();
+
+    CompileService::Statistics stats = server.getStatistics();
+    std::cerr << "Compile server stopped: " << stats.misses << " compiled, " << stats.hits
+              << " cached, " << stats.joins << " joined in flight, " << stats.evictions << " evicted" << std::endl;
+    return 0;
+}
+
+// Sends each input to a running server, printing replies in input order
+int runClient(const DriverOptions &options)
+{
+    CompileClient client(options.connectSocket);
+    size_t failed = 0;
+    for (const auto &path : options.inputs)
+    {
+        std::string source;
+        try
+        {
+            source = readFile(path);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << path << ": Error: " << e.what() << "\n";
+            failed++;
+            continue;
+        }
+
+        std::string text;
+        bool succeeded = client.compile(path, source, options.dumpAst, text);
+        (succeeded ? std::cout : std::cerr) << text;
+        if (!succeeded)
+            failed++;
+    }
+    if (options.stopServer)
+    {
+        client.stopServer();
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    DriverOptions options;
     try
     {
-        // Lexical analysis
-        Lexer lexer(input);
-        auto tokens = lexer.tokenize();
+        std::vector<std::string> args;
+        expandArguments(std::vector<std::string>(argv + 1, argv + argc), args);
+        if (!parseArguments(args, options))
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        // A precompiled module skips lexing, parsing, analysis and optimization
+        if (!options.loadModule.empty())
+        {
+            MappedFile file(options.loadModule);
+            ModuleReader reader(file);
+            auto program = reader.load();
+            std::cout << "Loaded " << reader.functionCount() << " function(s) from " << options.loadModule << "\n";
+            std::cout << "\nAST:\n";
+            printAST(std::cout, program.get());
+            return 0;
+        }
 
-        std::cout << "Tokens:\n";
-        for (const auto &token : tokens)
+        if (!options.connectSocket.empty())
         {
-            std::cout << "Token: " << tokenTypeToString(token.type)
-                      << " | Value: '" << token.value
-                      << "' | Line: " << token.line
-                      << " | Column: " << token.column << std::endl;
+            return runClient(options);
+        }
+        if (options.languageServer)
+        {
+            // stdout carries the protocol, so nothing else may be printed there
+            LanguageServer server(std::cin, std::cout);
+            return server.run();
         }
 
-        // Parsing
-        std::cout << "\nParsing AST:\n";
-        Parser parser(tokens);
-        auto ast = parser.parseFunction();
-        printAST(ast.get());
+        if (options.compile.allocationStats)
+        {
+            AllocationTracker::enable();
+        }
 
-        // Semantic Analysis
-        std::cout << "\nPerforming semantic analysis...\n";
-        SemanticAnalyzer analyzer;
-        analyzer.analyze(ast.get());
-        std::cout << "Semantic analysis completed successfully!\n";
+        TraceRecorder trace;
+        if (!options.traceFile.empty())
+        {
+            trace.nameThread("main");
+            options.compile.trace = &trace;
+        }
+        int status;
+        if (!options.serveSocket.empty())
+            status = runServer(options);
+        else if (!options.inputs.empty())
+            status = runBatch(options);
+        else
+            status = runExample(options);
+        if (!options.traceFile.empty())
+        {
+            trace.writeFile(options.traceFile);
+        }
+        return status;
     }
     catch (const SemanticError &e)
     {
@@ -133,6 +572,4 @@ int main() {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-
-    return 0;
 }